@@ -0,0 +1,529 @@
+/* Check binary and quantized snapshots against the OBJ text they were read */
+/* from. This needs no OpenGL context. Build and run it with "make test".   */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "obj.h"
+
+#define OBJ_FILE "test_bin.obj"
+#define MTL_FILE "test_bin.mtl"
+#define BIN_FILE "test_bin.bin"
+#define QNT_FILE "test_bin.qnt"
+#define BAD_FILE "test_bin.bad"
+#define TXT_FILE "test_bin.txt"
+#define TXM_FILE "test_bin.txm"
+#define OUT_FILE "test_bin.out"
+#define OUM_FILE "test_bin.oum"
+
+#define GRID 12
+
+static int fails = 0;
+
+static void check(int ok, const char *what)
+{
+    if (!ok && fails++ < 20)
+        fprintf(stderr, "FAIL: %s\n", what);
+}
+
+/*----------------------------------------------------------------------------*/
+
+/* Write a small OBJ of two materials: a wavy grid of quads with texture    */
+/* coordinates and normals, a pentagon, and a polyline without normals.     */
+
+static void make_obj(void)
+{
+    FILE *fp;
+    int   i;
+    int   j;
+
+    if ((fp = fopen(MTL_FILE, "w")))
+    {
+        fprintf(fp, "newmtl red\nKd 0.8 0.1 0.1\nKs 0.5 0.5 0.5\nNs 32\n");
+        fprintf(fp, "newmtl blue\nKd 0.1 0.2 0.9\nKe 0.0 0.0 0.3\n");
+        fclose(fp);
+    }
+    if ((fp = fopen(OBJ_FILE, "w")))
+    {
+        fprintf(fp, "mtllib " MTL_FILE "\n");
+
+        for (i = 0; i < GRID; ++i)
+            for (j = 0; j < GRID; ++j)
+            {
+                double x = 3.0 * i / (GRID - 1) - 1.25;
+                double z = 2.0 * j / (GRID - 1) + 0.5;
+                double y = 0.3 * sin(2.0 * x) * cos(3.0 * z);
+                double a = -0.6 * cos(2.0 * x) * cos(3.0 * z);
+                double b =  0.9 * sin(2.0 * x) * sin(3.0 * z);
+                double l = sqrt(a * a + 1.0 + b * b);
+
+                fprintf(fp, "v %.7g %.7g %.7g\n", x, y, z);
+                fprintf(fp, "vt %.7g %.7g\n", (double) i / (GRID - 1),
+                                              (double) j / (GRID - 1) * 2.0);
+                fprintf(fp, "vn %.7g %.7g %.7g\n", a / l, 1.0 / l, b / l);
+            }
+
+        for (i = 0; i < GRID - 1; ++i)
+        {
+            fprintf(fp, "usemtl %s\n", (i % 2) ? "blue" : "red");
+
+            for (j = 0; j < GRID - 1; ++j)
+            {
+                int k = i * GRID + j + 1;
+
+                fprintf(fp, "f %d/%d/%d %d/%d/%d %d/%d/%d %d/%d/%d\n",
+                        k,            k,            k,
+                        k + 1,        k + 1,        k + 1,
+                        k + GRID + 1, k + GRID + 1, k + GRID + 1,
+                        k + GRID,     k + GRID,     k + GRID);
+            }
+        }
+        fprintf(fp, "usemtl red\n");
+        fprintf(fp, "f 1/1/1 2/2/2 3/3/3 %d/%d/%d %d/%d/%d\n",
+                GRID + 3, GRID + 3, GRID + 3, GRID + 1, GRID + 1, GRID + 1);
+        fprintf(fp, "l 1/1 %d/%d %d/%d %d/%d\n", GRID + 2, GRID + 2,
+                GRID * 2 + 3, GRID * 2 + 3, GRID * GRID, GRID * GRID);
+        fclose(fp);
+    }
+}
+
+/*----------------------------------------------------------------------------*/
+
+static long file_size(const char *name)
+{
+    FILE *fp;
+    long  n = -1;
+
+    if ((fp = fopen(name, "rb")))
+    {
+        if (fseek(fp, 0, SEEK_END) == 0)
+            n = ftell(fp);
+        fclose(fp);
+    }
+    return n;
+}
+
+static unsigned char *load_file(const char *name, long *n)
+{
+    unsigned char *p = NULL;
+    FILE          *fp;
+
+    if ((*n = file_size(name)) > 0 && (fp = fopen(name, "rb")))
+    {
+        if ((p = (unsigned char *) malloc((size_t) *n)))
+            if (fread(p, 1, (size_t) *n, fp) != (size_t) *n)
+            {
+                free(p);
+                p = NULL;
+            }
+        fclose(fp);
+    }
+    return p;
+}
+
+static void save_file(const char *name, const unsigned char *p, long n)
+{
+    FILE *fp;
+
+    if ((fp = fopen(name, "wb")))
+    {
+        fwrite(p, 1, (size_t) n, fp);
+        fclose(fp);
+    }
+}
+
+static int same_file(const char *a, const char *b)
+{
+    unsigned char *p;
+    unsigned char *q;
+    long           m;
+    long           n;
+    int            r = 0;
+
+    if ((p = load_file(a, &m)) && (q = load_file(b, &n)))
+    {
+        r = (m == n && memcmp(p, q, (size_t) n) == 0);
+        free(q);
+    }
+    free(p);
+    return r;
+}
+
+/*----------------------------------------------------------------------------*/
+
+/* Confirm that two OBJs hold the same materials, surfaces, and elements.   */
+
+static void same_mtrl(const obj *A, const obj *B)
+{
+    float a[4];
+    float b[4];
+    int   mi;
+    int   ki;
+
+    check(obj_num_mtrl(A) == obj_num_mtrl(B), "material count");
+
+    for (mi = 0; mi < obj_num_mtrl(A) && mi < obj_num_mtrl(B); ++mi)
+    {
+        check(strcmp(obj_get_mtrl_name(A, mi),
+                     obj_get_mtrl_name(B, mi)) == 0, "material name");
+
+        for (ki = 0; ki < OBJ_PROP_COUNT; ++ki)
+        {
+            obj_get_mtrl_c(A, mi, ki, a);
+            obj_get_mtrl_c(B, mi, ki, b);
+            check(memcmp(a, b, sizeof (a)) == 0, "material color");
+        }
+    }
+}
+
+static int same_tri(const int *a, const int *b)
+{
+    /* Triangles match if one is a rotation of the other. */
+
+    return (a[0] == b[0] && a[1] == b[1] && a[2] == b[2]) ||
+           (a[0] == b[1] && a[1] == b[2] && a[2] == b[0]) ||
+           (a[0] == b[2] && a[1] == b[0] && a[2] == b[1]);
+}
+
+static void same_elem(const obj *A, const obj *B, int rotated)
+{
+    int si;
+    int k;
+
+    check(obj_num_surf(A) == obj_num_surf(B), "surface count");
+
+    for (si = 0; si < obj_num_surf(A) && si < obj_num_surf(B); ++si)
+    {
+        check(obj_get_surf(A, si) == obj_get_surf(B, si), "surface material");
+        check(obj_num_poly(A, si) == obj_num_poly(B, si), "polygon count");
+        check(obj_num_line(A, si) == obj_num_line(B, si), "line count");
+
+        for (k = 0; k < obj_num_poly(A, si) && k < obj_num_poly(B, si); ++k)
+        {
+            int a[3];
+            int b[3];
+
+            obj_get_poly(A, si, k, a);
+            obj_get_poly(B, si, k, b);
+
+            if (rotated)
+                check(same_tri(a, b), "polygon");
+            else
+                check(memcmp(a, b, sizeof (a)) == 0, "polygon");
+        }
+        for (k = 0; k < obj_num_line(A, si) && k < obj_num_line(B, si); ++k)
+        {
+            int a[2];
+            int b[2];
+
+            obj_get_line(A, si, k, a);
+            obj_get_line(B, si, k, b);
+            check(memcmp(a, b, sizeof (a)) == 0, "line");
+        }
+    }
+}
+
+static void same_obj(const obj *A, const obj *B, const char *what)
+{
+    float a[3];
+    float b[3];
+    int   vi;
+    int   f = fails;
+
+    /* Vertex attributes must match bit for bit, absent normals included. */
+
+    same_mtrl(A, B);
+
+    check(obj_num_vert(A) == obj_num_vert(B), "vertex count");
+
+    for (vi = 0; vi < obj_num_vert(A) && vi < obj_num_vert(B); ++vi)
+    {
+        obj_get_vert_v(A, vi, a);
+        obj_get_vert_v(B, vi, b);
+        check(memcmp(a, b, sizeof (float) * 3) == 0, "vertex position");
+
+        obj_get_vert_t(A, vi, a);
+        obj_get_vert_t(B, vi, b);
+        check(memcmp(a, b, sizeof (float) * 2) == 0, "texture coordinate");
+
+        obj_get_vert_n(A, vi, a);
+        obj_get_vert_n(B, vi, b);
+        check(memcmp(a, b, sizeof (float) * 3) == 0, "vertex normal");
+    }
+    same_elem(A, B, 0);
+
+    printf("%s: %s\n", what, (fails == f) ? "identical" : "different");
+}
+
+/*----------------------------------------------------------------------------*/
+
+/* Confirm that every single-bit change and every truncation is refused.    */
+
+static int corrupt(const char *name, obj *(*open)(const char *),
+                                     long from, long to, int trunc)
+{
+    unsigned char *p;
+    obj           *O;
+    long           n;
+    long           i;
+    int            c = 0;
+
+    if ((p = load_file(name, &n)))
+    {
+        if (to > n) to = n;
+
+        for (i = from; i < to; ++i)
+        {
+            p[i] ^= (unsigned char) (1 << (i % 8));
+            save_file(BAD_FILE, p, n);
+            p[i] ^= (unsigned char) (1 << (i % 8));
+
+            if ((O = open(BAD_FILE)))
+            {
+                check(0, "bit change accepted");
+                obj_delete(O);
+            }
+            c++;
+        }
+        for (i = 0; trunc && i < n; i += (i < 256) ? 1 : 61)
+        {
+            save_file(BAD_FILE, p, i);
+
+            if ((O = open(BAD_FILE)))
+            {
+                check(0, "truncation accepted");
+                obj_delete(O);
+            }
+            c++;
+        }
+        free(p);
+    }
+    remove(BAD_FILE);
+    return c;
+}
+
+/*----------------------------------------------------------------------------*/
+
+static void test_bin(const obj *O)
+{
+    obj *B;
+    int  c;
+
+    /* A snapshot reads back exactly and writes the same OBJ text. */
+
+    check(obj_write_bin(O, BIN_FILE), "write binary snapshot");
+
+    if ((B = obj_create_bin(BIN_FILE)))
+    {
+        same_obj(O, B, "binary");
+
+        obj_write(B, OUT_FILE, OUM_FILE, 7);
+        check(same_file(TXT_FILE, OUT_FILE), "binary OBJ text");
+        check(same_file(TXM_FILE, OUM_FILE), "binary MTL text");
+        obj_delete(B);
+    }
+    else check(0, "read binary snapshot");
+
+    c = corrupt(BIN_FILE, obj_create_bin, 0, file_size(BIN_FILE), 1);
+
+    printf("binary: %d corruptions refused\n", c);
+}
+
+static void test_mapped(const obj *O)
+{
+    obj *B;
+    int  c;
+
+    /* A mapped snapshot matches too, whether or not it is modified. */
+
+    if ((B = obj_create_mapped(BIN_FILE)))
+    {
+        float v[3] = { 1.0f, 2.0f, 3.0f };
+
+        same_obj(O, B, "mapped");
+
+        obj_write(B, OUT_FILE, OUM_FILE, 7);
+        check(same_file(TXT_FILE, OUT_FILE), "mapped OBJ text");
+        check(same_file(TXM_FILE, OUM_FILE), "mapped MTL text");
+
+        obj_set_vert_v(B, 0, v);
+        obj_get_vert_v(B, 0, v);
+        check(v[0] == 1.0f && v[1] == 2.0f && v[2] == 3.0f, "mapped change");
+        obj_delete(B);
+
+        if ((B = obj_create_mapped(BIN_FILE)))
+        {
+            obj_get_vert_v(B, 0, v);
+            check(v[0] != 1.0f, "mapped change reached the file");
+            obj_delete(B);
+        }
+    }
+    else check(0, "map binary snapshot");
+
+    /* Mapping validates only the header, the first 48 bytes before the */
+    /* checksum, so payload changes are not sought here.                */
+
+    c = corrupt(BIN_FILE, obj_create_mapped, 0, 48, 1);
+
+    printf("mapped: %d corruptions refused\n", c);
+}
+
+/*----------------------------------------------------------------------------*/
+
+static float dist(const float *a, const float *b, int n)
+{
+    float d = 0.0f;
+    int   i;
+
+    for (i = 0; i < n; ++i)
+        d += (a[i] - b[i]) * (a[i] - b[i]);
+
+    return sqrtf(d);
+}
+
+static void test_quant(const obj *O, int vb, int tb, int nb)
+{
+    float bound[6];
+    float tr[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    float ve = 0.0f;
+    float te = 0.0f;
+    float ne = 0.0f;
+    float vs = 0.0f;
+    float ts = 0.0f;
+    float ns;
+    obj  *Q;
+    int   vi;
+    int   i;
+    int   c;
+
+    /* Find the quantization steps of positions and texture coordinates. */
+
+    obj_bound(O, bound);
+
+    for (vi = 0; vi < obj_num_vert(O); ++vi)
+    {
+        float t[2];
+
+        obj_get_vert_t(O, vi, t);
+
+        if (vi == 0 || tr[0] > t[0]) tr[0] = t[0];
+        if (vi == 0 || tr[1] > t[1]) tr[1] = t[1];
+        if (vi == 0 || tr[2] < t[0]) tr[2] = t[0];
+        if (vi == 0 || tr[3] < t[1]) tr[3] = t[1];
+    }
+    for (i = 0; i < 3; ++i)
+        if (vs < bound[i + 3] - bound[i])
+            vs = bound[i + 3] - bound[i];
+    for (i = 0; i < 2; ++i)
+        if (ts < tr[i + 2] - tr[i])
+            ts = tr[i + 2] - tr[i];
+
+    vs /= (float) ((1L << vb) - 1);
+    ts /= (float) ((1L << tb) - 1);
+    ns  = 2.0f / (float) ((1L << nb) - 1);
+
+    /* Each value must come back within its tolerance, and absent normals */
+    /* as zero. The elements may be rotated, with their winding kept.     */
+
+    check(obj_write_quant(O, QNT_FILE, vb, tb, nb), "write quantized snapshot");
+
+    if ((Q = obj_create_quant(QNT_FILE)))
+    {
+        same_mtrl(O, Q);
+
+        check(obj_num_vert(O) == obj_num_vert(Q), "quantized vertex count");
+
+        for (vi = 0; vi < obj_num_vert(O) && vi < obj_num_vert(Q); ++vi)
+        {
+            float a[3];
+            float b[3];
+            float d;
+
+            obj_get_vert_v(O, vi, a);
+            obj_get_vert_v(Q, vi, b);
+            for (i = 0; i < 3; ++i)
+                if (ve < (d = fabsf(a[i] - b[i]))) ve = d;
+
+            obj_get_vert_t(O, vi, a);
+            obj_get_vert_t(Q, vi, b);
+            for (i = 0; i < 2; ++i)
+                if (te < (d = fabsf(a[i] - b[i]))) te = d;
+
+            obj_get_vert_n(O, vi, a);
+            obj_get_vert_n(Q, vi, b);
+
+            if (isfinite(a[0]) && isfinite(a[1]) && isfinite(a[2]) &&
+                (a[0] != 0.0f || a[1] != 0.0f || a[2] != 0.0f))
+            {
+                if (ne < (d = dist(a, b, 3))) ne = d;
+            }
+            else
+                check(b[0] == 0.0f && b[1] == 0.0f && b[2] == 0.0f,
+                      "absent quantized normal");
+        }
+        same_elem(O, Q, 1);
+        obj_delete(Q);
+    }
+    else check(0, "read quantized snapshot");
+
+    /* Positions and texture coordinates lie within half a step. A normal */
+    /* lies within half a step of each octahedral coordinate, a distance  */
+    /* stretched by at most the square root of three on the unit sphere.  */
+
+    check(ve <= 0.5f * vs * 1.0001f, "quantized position error");
+    check(te <= 0.5f * ts * 1.0001f, "quantized texture coordinate error");
+    check(ne <= ns * sqrtf(1.5f), "quantized normal error");
+
+    printf("quant %d %d %d: errors %.2g %.2g %.2g of steps %.2g %.2g %.2g\n",
+           vb, tb, nb, ve, te, ne, vs, ts, ns);
+
+    c = corrupt(QNT_FILE, obj_create_quant, 0, file_size(QNT_FILE), 1);
+
+    printf("quant %d %d %d: %d corruptions refused\n", vb, tb, nb, c);
+}
+
+/*----------------------------------------------------------------------------*/
+
+int main(void)
+{
+    obj *O;
+
+    make_obj();
+
+    if ((O = obj_create(OBJ_FILE)))
+    {
+        check(obj_num_vert(O) > GRID * GRID, "text vertex count");
+        check(obj_num_surf(O) == 2, "text surface count");
+
+        /* Keep the text path's own output, naming the same MTL file. */
+
+        obj_write(O, OUT_FILE, OUM_FILE, 7);
+        rename(OUT_FILE, TXT_FILE);
+        rename(OUM_FILE, TXM_FILE);
+
+        test_bin(O);
+        test_mapped(O);
+        test_quant(O, 16, 12, 10);
+        test_quant(O,  8,  6,  4);
+        obj_delete(O);
+    }
+    else check(0, "read OBJ text");
+
+    remove(TXT_FILE);
+    remove(TXM_FILE);
+    remove(OUT_FILE);
+    remove(OUM_FILE);
+    remove(BIN_FILE);
+    remove(QNT_FILE);
+    remove(OBJ_FILE);
+    remove(MTL_FILE);
+
+    if (fails)
+        printf("%d failures\n", fails);
+    else
+        printf("ok\n");
+
+    return fails ? EXIT_FAILURE : EXIT_SUCCESS;
+}
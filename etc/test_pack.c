@@ -0,0 +1,352 @@
+/* Check the vertex packing of obj_pack_vert against reference encodings.   */
+/* This needs no OpenGL context. Build and run it with "make test".         */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "obj.h"
+
+#define BATCH 65536
+
+static int fails = 0;
+
+static void check(int ok, const char *what)
+{
+    if (!ok && fails++ < 20)
+        fprintf(stderr, "FAIL: %s\n", what);
+}
+
+/*----------------------------------------------------------------------------*/
+
+/* Round a float to half precision, nearest even, using double arithmetic. */
+
+static unsigned int half_ref(float f)
+{
+    unsigned int s = signbit(f) ? 0x8000 : 0;
+    double       a = fabs((double) f);
+    double       q;
+    int          e;
+
+    if (isnan(f))     return s | 0x7E00;
+    if (a >= 65520.0) return s | 0x7C00;
+
+    if (a < ldexp(1.0, -14))
+        return s | (unsigned int) rint(ldexp(a, 24));
+
+    frexp(a, &e);
+    q = rint(ldexp(a, 11 - e));
+
+    return s | (((unsigned int) (e + 14) << 10) + (unsigned int) q - 1024);
+}
+
+static float snorm10_dec(unsigned int w, int i)
+{
+    int v = (int) ((w >> (10 * i)) & 0x3FF);
+
+    if (v & 0x200) v -= 1024;
+
+    return (v < -511) ? -1.0f : v / 511.0f;
+}
+
+static float clamp(float f, float a, float z)
+{
+    if (f != f) return 0.0f;
+    if (f <  a) return a;
+    if (f >  z) return z;
+    return f;
+}
+
+/*----------------------------------------------------------------------------*/
+
+/* Produce a sample of float bit patterns: a stride through all of them     */
+/* and, for each exponent, values on and beside half-precision ties.        */
+
+static int next_bits(unsigned long *i, unsigned int *b)
+{
+    const unsigned long n = 0x100000000UL / 127 + 1;
+
+    unsigned long j;
+    unsigned int  e;
+    unsigned int  t;
+    unsigned int  m;
+    int           k;
+
+    if (*i < n)
+    {
+        *b = (unsigned int) (*i * 127);
+        return (*i)++, 1;
+    }
+    if ((j = *i - n) < 256 * 2 * 1024 * 3)
+    {
+        e = (unsigned int) (j / 6144);
+        t = (unsigned int) (j % 6144) / 6;
+        k = (e >= 113) ? 13 : (e >= 103 ? 126 - (int) e : 23);
+
+        m = ((t << k) | (1u << (k - 1))) + (unsigned int) (j % 3) - 1;
+
+        *b = ((unsigned int) (j / 3 % 2) << 31) | (e << 23) | (m & 0x7FFFFF);
+        return (*i)++, 1;
+    }
+    return 0;
+}
+
+static void test_half(void)
+{
+    static unsigned short h[BATCH * 4];
+    static float          f[BATCH];
+
+    obj          *O = obj_create(NULL);
+    unsigned long i = 0;
+    unsigned int  b;
+    unsigned long c = 0;
+    int n;
+    int k;
+
+    obj_set_vert_loc(O, -1, -1, -1, 0);
+    obj_set_vert_fmt(O, OBJ_VERT_HALF_V);
+
+    for (k = 0; k < BATCH; ++k)
+        obj_add_vert(O);
+
+    check(obj_pack_vert(O, NULL) == 8, "half position stride");
+
+    /* Pack each batch of patterns as vertex x and compare with the reference. */
+
+    do
+    {
+        for (n = 0; n < BATCH && next_bits(&i, &b); ++n)
+        {
+            float v[3];
+
+            memcpy(f + n, &b, sizeof (float));
+            v[0] = f[n];
+            v[1] = v[2] = 0.0f;
+            obj_set_vert_v(O, n, v);
+        }
+
+        obj_pack_vert(O, h);
+
+        for (k = 0; k < n; ++k)
+        {
+            unsigned int r = half_ref(f[k]);
+            unsigned int g = h[4 * k];
+
+            if (isnan(f[k]))
+                check((g & 0x7C00) == 0x7C00 && (g & 0x3FF) != 0
+                                             && (g ^ r) < 0x8000, "half NaN");
+            else
+                check(g == r, "half rounding");
+#ifdef __FLT16_MAX__
+            if (!isnan(f[k]))
+            {
+                _Float16       x = (_Float16) f[k];
+                unsigned short y;
+
+                memcpy(&y, &x, sizeof (y));
+                check(g == y, "half rounding against _Float16");
+            }
+#endif
+            check(h[4 * k + 1] == 0 && h[4 * k + 3] == 0, "half padding");
+        }
+        c += n;
+    }
+    while (n == BATCH);
+
+    printf("half:    %lu patterns\n", c);
+    obj_delete(O);
+}
+
+/*----------------------------------------------------------------------------*/
+
+static void test_snorm10(void)
+{
+    static unsigned int w[BATCH];
+
+    obj  *O = obj_create(NULL);
+    float e = 0.0f;
+    int   k;
+
+    obj_set_vert_loc(O, -1, 0, -1, -1);
+    obj_set_vert_fmt(O, OBJ_VERT_SNORM_N);
+
+    for (k = 0; k < BATCH; ++k)
+    {
+        float n[3];
+
+        n[0] = -1.25f + 2.5f * k / (BATCH - 1);
+        n[1] = -n[0];
+        n[2] = (k == 0) ? (float) NAN : n[0] * 0.5f;
+
+        obj_set_vert_n(O, obj_add_vert(O), n);
+    }
+
+    check(obj_pack_vert(O, NULL) == 4, "snorm10 normal stride");
+    obj_pack_vert(O, w);
+
+    for (k = 0; k < BATCH; ++k)
+    {
+        float n[3];
+        int   i;
+
+        obj_get_vert_n(O, k, n);
+
+        for (i = 0; i < 3; ++i)
+        {
+            float d = fabsf(snorm10_dec(w[k], i) - clamp(n[i], -1, 1));
+
+            if (e < d) e = d;
+        }
+        check((w[k] >> 30) == 0, "snorm10 w bits");
+    }
+    check(e <= 0.5f / 511 + 1e-6f, "snorm10 error bound");
+    check((w[0] >> 20) == 0, "snorm10 NaN");
+
+    printf("snorm10: max error %.6f, bound %.6f\n", e, 0.5f / 511);
+    obj_delete(O);
+}
+
+static void test_unorm16(void)
+{
+    static unsigned short h[BATCH * 2];
+
+    obj  *O = obj_create(NULL);
+    float e = 0.0f;
+    int   k;
+
+    obj_set_vert_loc(O, -1, -1, 0, -1);
+    obj_set_vert_fmt(O, OBJ_VERT_UNORM_T | OBJ_VERT_HALF_T);
+
+    for (k = 0; k < BATCH; ++k)
+    {
+        float t[2];
+
+        t[0] = -0.5f + 2.0f * k / (BATCH - 1);
+        t[1] = (k == 0) ? (float) NAN : (float) k / (BATCH - 1);
+
+        obj_set_vert_t(O, obj_add_vert(O), t);
+    }
+
+    check(obj_pack_vert(O, NULL) == 4, "unorm16 texture coordinate stride");
+    obj_pack_vert(O, h);
+
+    for (k = 0; k < BATCH; ++k)
+    {
+        float t[2];
+        int   i;
+
+        obj_get_vert_t(O, k, t);
+
+        for (i = 0; i < 2; ++i)
+        {
+            float d = fabsf(h[2 * k + i] / 65535.0f - clamp(t[i], 0, 1));
+
+            if (e < d) e = d;
+        }
+    }
+    check(e <= 0.5f / 65535 + 1e-7f, "unorm16 error bound");
+    check(h[1] == 0, "unorm16 NaN");
+
+    printf("unorm16: max error %.9f, bound %.9f\n", e, 0.5f / 65535);
+    obj_delete(O);
+}
+
+/*----------------------------------------------------------------------------*/
+
+static void test_layout(void)
+{
+    static const struct
+    {
+        int          loc[4];
+        unsigned int fmt;
+        size_t       s;
+    }
+    T[] = {
+        { {  0,  1,  2,  3 }, 0,  44 },
+        { {  0,  1,  2,  3 }, 7,  20 },
+        { {  0,  1,  2,  3 }, 11, 20 },
+        { {  0,  1,  2,  3 }, 2,  28 },
+        { { -1,  1,  2,  3 }, 0,  32 },
+        { { -1,  1,  2,  3 }, 7,  16 },
+        { { -1, -1, -1,  3 }, 0,  12 },
+        { { -1, -1, -1,  3 }, 1,   8 },
+        { { -1, -1, -1, -1 }, 15,  0 },
+    };
+
+    const float u[3] = { 0.0f, 1.0f,   0.0f };
+    const float n[3] = { 0.6f, 0.0f,  -0.8f };
+    const float t[2] = { 0.25f, 0.5f };
+    const float v[3] = { 1.5f, -3.25f, 100.0f };
+
+    unsigned char  p[64];
+    unsigned int   w;
+    unsigned short h[4];
+    float          f[11];
+
+    obj *O = obj_create(NULL);
+    int  i;
+
+    obj_add_vert(O);
+    obj_set_vert_u(O, 0, u);
+    obj_set_vert_n(O, 0, n);
+    obj_set_vert_t(O, 0, t);
+    obj_set_vert_v(O, 0, v);
+
+    for (i = 0; i < (int) (sizeof (T) / sizeof (T[0])); ++i)
+    {
+        obj_set_vert_loc(O, T[i].loc[0], T[i].loc[1], T[i].loc[2],
+                                                      T[i].loc[3]);
+        obj_set_vert_fmt(O, T[i].fmt);
+        check(obj_pack_vert(O, NULL) == T[i].s, "layout stride");
+    }
+
+    /* The default format keeps the float layout, u n t v. */
+
+    obj_set_vert_loc(O, 0, 1, 2, 3);
+    obj_set_vert_fmt(O, 0);
+    obj_pack_vert(O, f);
+
+    check(!memcmp(f + 0, u, 12) && !memcmp(f + 3, n, 12) &&
+          !memcmp(f + 6, t,  8) && !memcmp(f + 8, v, 12), "float offsets");
+
+    /* The packed format places u n t v at 0, 4, 8, and 12. */
+
+    obj_set_vert_fmt(O, OBJ_VERT_HALF_V | OBJ_VERT_SNORM_N
+                                        | OBJ_VERT_UNORM_T);
+    memset(p, 0xAA, sizeof (p));
+    obj_pack_vert(O, p);
+
+    memcpy(&w, p + 0, 4);
+    check(snorm10_dec(w, 0) == 0 && snorm10_dec(w, 1) == 1
+                                 && snorm10_dec(w, 2) == 0, "tangent offset");
+    memcpy(&w, p + 4, 4);
+    check(fabsf(snorm10_dec(w, 0) - n[0]) < 0.002f
+       && fabsf(snorm10_dec(w, 2) - n[2]) < 0.002f, "normal offset");
+    memcpy(h, p + 8, 4);
+    check(h[0] == 16384 && h[1] == 32768, "texture coordinate offset");
+    memcpy(h, p + 12, 8);
+    check(h[0] == half_ref(v[0]) && h[1] == half_ref(v[1])
+       && h[2] == half_ref(v[2]) && h[3] == 0, "position offset");
+    check(p[20] == 0xAA, "packed stride");
+
+    printf("layout:  %d formats\n", (int) (sizeof (T) / sizeof (T[0])));
+    obj_delete(O);
+}
+
+/*----------------------------------------------------------------------------*/
+
+int main(void)
+{
+    test_layout();
+    test_snorm10();
+    test_unorm16();
+    test_half();
+
+    if (fails)
+        printf("%d failures\n", fails);
+    else
+        printf("ok\n");
+
+    return fails ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -22,9 +22,36 @@
 #include <ctype.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 #include <assert.h>
+#include <float.h>
+#include <limits.h>
 #include <math.h>
 
+#ifdef _WIN32
+#define CONF_NO_MMAP
+#define CONF_NO_THREADS
+#endif
+
+#ifndef CONF_NO_THREADS
+#include <pthread.h>
+#endif
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+#ifndef CONF_NO_MMAP
+#include <sys/mman.h>
+#include <fcntl.h>
+#endif
+
 #ifndef CONF_NO_GL
 #ifdef __APPLE__
 #  include <OpenGL/gl3.h>
@@ -34,15 +61,18 @@
 #endif
 
 #define MAXSTR 1024
+#define MAXBUF 1048576
+#define MAXSET 8
+#define MAXSTEP 1024
 
 /*============================================================================*/
 
+/* Indices are stored at full width. Surfaces that span few enough vertices */
+/* are uploaded with 16-bit indices regardless. See surf_base.              */
+
 #define index_t       unsigned int
 #define GL_INDEX_T GL_UNSIGNED_INT
-/*
-#define index_t       unsigned short
-#define GL_INDEX_T GL_UNSIGNED_SHORT
-*/
+
 /*============================================================================*/
 
 #include "obj.h"
@@ -53,6 +83,8 @@ struct obj_prop
     int          opt;
     unsigned int map;
 
+    struct obj_image *img;
+
     float c[4];
     float o[3];
     float s[3];
@@ -65,6 +97,9 @@ struct obj_mtrl
     struct obj_prop kv[OBJ_PROP_COUNT];
 };
 
+/* Vertex attributes are stored in separate arrays. This record of all of   */
+/* them gives the vertex size named in snapshot headers.                     */
+
 struct obj_vert
 {
     float u[3];
@@ -94,11 +129,36 @@ struct obj_surf
 
     unsigned int pibo;
     unsigned int libo;
+    int          ibase;         /* Base vertex of 16-bit indices, or -1 */
 
     struct obj_poly *pv;
     struct obj_line *lv;
 };
 
+/* The cache settings in effect for one read, taken as the read begins. */
+
+struct cache_opt
+{
+    char  dir[MAXSTR];          /* Cache directory, or empty if none    */
+    float eps;                  /* Welding distance, or negative        */
+    float dot;                  /* Welding normal agreement             */
+    int   qc;                   /* Sorting cache size, or zero          */
+};
+
+struct obj_task
+{
+#ifndef CONF_NO_THREADS
+    pthread_t       thread;     /* Worker reading the file              */
+    pthread_mutex_t mutex;      /* Guard of the completion flag         */
+    pthread_cond_t  cond;       /* Signal of completion                 */
+    int             joinable;   /* Worker has yet to be joined          */
+#endif
+    char           *filename;   /* File being read                      */
+    struct cache_opt cache;     /* Cache settings at the read's start   */
+    int             done;       /* Read and processing are complete     */
+    int             r;          /* Result of the read                   */
+};
+
 struct obj
 {
     unsigned int vao;
@@ -111,6 +171,16 @@ struct obj
     int sc;
     int sm;
 
+    unsigned int ropt;
+    unsigned int wopt;
+    unsigned int vfmt;
+    int          threads;
+
+    obj_progress pfn;
+    void        *pdata;
+    obj_selector sfn;
+    void        *sdata;
+
     int uloc;
     int nloc;
     int tloc;
@@ -121,11 +191,25 @@ struct obj
     int Mloc[OBJ_PROP_COUNT];
 
     struct obj_mtrl *mv;
-    struct obj_vert *vv;
     struct obj_surf *sv;
+
+    float (*uv)[3];             /* Vertex tangents                      */
+    float (*nv)[3];             /* Vertex normals                       */
+    float (*tv)[2];             /* Vertex texture coordinates           */
+    float (*vv)[3];             /* Vertex positions                     */
+
+    struct obj_task *task;
+
+    char  *bp;                  /* Mapped snapshot, if any              */
+    size_t bn;                  /* Mapped snapshot size                 */
 };
 
-static void invalidate(obj *);
+static void  invalidate(obj *);
+static char *set_name(char *, const char *);
+static int   own_map(obj *);
+
+static int read_bin (obj *,       const char *, const char *, int);
+static int write_bin(const obj *, const char *, const char *);
 
 /*----------------------------------------------------------------------------*/
 
@@ -143,13 +227,32 @@ static void invalidate(obj *);
 #define assert_prop(O, i, j) \
       { assert_mtrl(O, i); assert(0 <= j && j < OBJ_PROP_COUNT); }
 
+/*----------------------------------------------------------------------------*/
+
+static int report(const obj *O, int stage, size_t i, size_t n)
+{
+    /* Report progress, returning nonzero if the callback asks to stop. */
+
+    return (O->pfn && O->pfn(O->pdata, stage, i, n));
+}
+
+static size_t num_polys(const obj *O)
+{
+    size_t n = 0;
+    int   si;
+
+    for (si = 0; si < O->sc; ++si)
+        n += (size_t) O->sv[si].pc;
+
+    return n;
+}
+
 /*============================================================================*/
 /* Vector cache                                                               */
 
 struct vec2
 {
     float v[2];
-    int _ii;
 };
 
 struct vec3
@@ -158,26 +261,30 @@ struct vec3
     int _ii;
 };
 
+/* An index set maps one distinct v/vt/vn triple, in one smoothing group, to */
+/* the vertex created for it. The first few sets at each position are listed */
+/* from that position, in the order read, which keeps lookups local. Further */
+/* sets go to an open-addressed hash table, so lookups are bounded no matter */
+/* how many distinct sets share a position.                                  */
+
 struct iset
 {
-    int vi;
-    int gi;
-
     int _vi;
     int _ti;
     int _ni;
-    int _ii;
+    int  gi;
+    int  vi;                    /* Vertex index, or -1 if the slot is empty */
+    int _ii;                    /* Next listed set at the same position     */
 };
 
-static int _vc, _vm;
-static int _tc, _tm;
-static int _nc, _nm;
-static int _ic, _im;
+/* An index reference records one corner of the face or line being read. */
 
-static struct vec3 *_vv;
-static struct vec2 *_tv;
-static struct vec3 *_nv;
-static struct iset *_iv;
+struct iref
+{
+    int _vi;
+    int _ni;
+    int  vi;
+};
 
 /*----------------------------------------------------------------------------*/
 
@@ -205,24 +312,313 @@ static int add__(void **_v, int *_c, int *_m, size_t _s)
     else return -1;
 }
 
-static int add_v(void)
+static int reserve__(void **_v, int *_m, size_t _s, int n)
+{
+    void *v;
+
+    /* Grow the block to hold at least n elements, if it does not already. */
+
+    if (n > *_m)
+    {
+        if ((v = realloc(*_v, _s * n)) == NULL)
+            return 0;
+
+        *_v = v;
+        *_m = n;
+    }
+    return 1;
+}
+
+/*----------------------------------------------------------------------------*/
+
+/* The vertex attribute arrays share one count and capacity and grow as one. */
+
+#define VERT_ARRAYS 4
+
+static void **vert_array(obj *O, int k, size_t *s)
+{
+    switch (k)
+    {
+    case 0:  *s = sizeof (*O->uv); return (void **) &O->uv;
+    case 1:  *s = sizeof (*O->nv); return (void **) &O->nv;
+    case 2:  *s = sizeof (*O->tv); return (void **) &O->tv;
+    default: *s = sizeof (*O->vv); return (void **) &O->vv;
+    }
+}
+
+static int reserve_vert(obj *O, int n)
+{
+    void **p;
+    size_t s;
+    int    m;
+    int    k;
+
+    /* Grow every vertex array to hold at least n vertices. */
+
+    for (k = 0; k < VERT_ARRAYS; ++k)
+    {
+        p = vert_array(O, k, &s);
+        m = O->vm;
+
+        if (reserve__(p, &m, s, n) == 0)
+            return 0;
+    }
+    if (O->vm < n)
+        O->vm = n;
+
+    return 1;
+}
+
+/*----------------------------------------------------------------------------*/
+
+/* A material definition locates one newmtl block within a loaded library. */
+
+struct mtl_def
+{
+    const char *name;           /* Material name, within the library    */
+    size_t      n;              /* Length of the material name          */
+    const char *c;              /* Start of the material's properties   */
+    const char *e;              /* End of the material's properties     */
+    int         li;             /* Index of the defining library        */
+};
+
+/* A material library's text is kept, mapped or allocated, for the load.  */
+
+struct mtl_lib
+{
+    char  *p;                   /* Library text                         */
+    size_t n;                   /* Library size                         */
+    int    mapped;              /* Text is mapped rather than allocated */
+};
+
+/* A material use maps a usemtl name to the surface created for it. */
+
+struct mtl_use
+{
+    char *name;                 /* Material name, or NULL if unused     */
+    int   si;                   /* Index of the receiving surface, or -1 */
+    int   pc;                   /* Prescanned polygon count             */
+    int   lc;                   /* Prescanned line count                */
+};
+
+/* All state of a load in progress is held here, so that any number of loads */
+/* may proceed concurrently. The vector caches are released when it's done.  */
+
+struct obj_load
+{
+    obj *O;                     /* Object receiving the loaded geometry */
+
+    int  si;                    /* Current surface index                */
+    int  gi;                    /* Current smoothing group              */
+
+    char dir[MAXSTR];           /* Directory containing the OBJ file    */
+
+    obj_resolver res;           /* Resolver of MTL and image names      */
+    void        *res_data;      /* Resolver user data                   */
+    int          defer;         /* Leave texture uploads to obj_init    */
+    char        *dep;           /* Files read, if recording for a cache */
+
+    int os;                     /* Current object is selected           */
+    int gs;                     /* A current group is selected          */
+    int sel;                    /* Faces and lines are being loaded     */
+
+    size_t nb;                  /* Bytes read                           */
+    size_t nr;                  /* Bytes read at the next report        */
+    size_t nt;                  /* Bytes in total, or zero if unknown   */
+    int    halt;                /* The read was cancelled               */
+
+    char  *buf;                 /* Partial line carried between feeds   */
+    size_t bc, bm;
+
+    int  vn, tn, nn;            /* Prescanned vector counts             */
+    int  in;                    /* Prescanned face and line corners     */
+    int  vx;                    /* Prescanned bound on the vertex count */
+    int  pn, ln;                /* Prescanned default surface counts    */
+    int *pp, *lp;               /* Prescan polygon and line count sinks */
+
+    int _vc, _vm;
+    int _tc, _tm;
+    int _nc, _nm;
+    int _ic, _im;
+    int _sc, _sm;
+    int _hc, _hm;
+    int _lc, _lm;
+    int _dc, _dm;
+    int _dh;
+    int _uc, _uh;
+
+    struct vec3    *_vv;
+    struct vec2    *_tv;
+    struct vec3    *_nv;
+    struct iref    *_iv;
+    struct iset    *_sv;
+    struct iset    *_hv;
+    struct mtl_lib *_lv;
+    struct mtl_def *_dv;
+    int            *_dt;
+    struct mtl_use *_uv;
+};
+
+static int add_v(struct obj_load *L)
+{
+    return add__((void **) &L->_vv, &L->_vc, &L->_vm, sizeof (struct vec3));
+}
+
+static int add_t(struct obj_load *L)
+{
+    return add__((void **) &L->_tv, &L->_tc, &L->_tm, sizeof (struct vec2));
+}
+
+static int add_n(struct obj_load *L)
+{
+    return add__((void **) &L->_nv, &L->_nc, &L->_nm, sizeof (struct vec3));
+}
+
+static int add_i(struct obj_load *L)
+{
+    return add__((void **) &L->_iv, &L->_ic, &L->_im, sizeof (struct iref));
+}
+
+static int add_s(struct obj_load *L)
+{
+    return add__((void **) &L->_sv, &L->_sc, &L->_sm, sizeof (struct iset));
+}
+
+static int add_l(struct obj_load *L)
+{
+    return add__((void **) &L->_lv, &L->_lc, &L->_lm,
+                                                sizeof (struct mtl_lib));
+}
+
+static int add_d(struct obj_load *L)
+{
+    return add__((void **) &L->_dv, &L->_dc, &L->_dm, sizeof (struct mtl_def));
+}
+
+/*----------------------------------------------------------------------------*/
+
+static unsigned int hash_iset(int _vi, int _ti, int _ni, int gi)
 {
-    return add__((void **) &_vv, &_vc, &_vm, sizeof (struct vec3));
+    unsigned int h = (unsigned int) _vi * 0x9E3779B1u
+                   ^ (unsigned int) _ti * 0x85EBCA77u
+                   ^ (unsigned int) _ni * 0xC2B2AE3Du
+                   ^ (unsigned int)  gi * 0x27D4EB2Fu;
+
+    h ^= h >> 15;
+    h *= 0x2C1B3C6Du;
+    h ^= h >> 12;
+
+    return h;
 }
 
-static int add_t(void)
+static int grow_iset(struct obj_load *L)
 {
-    return add__((void **) &_tv, &_tc, &_tm, sizeof (struct vec2));
+    int m = (L->_hm > 0) ? L->_hm * 2 : 1024;
+    int i;
+    int j;
+
+    struct iset *v;
+
+    /* Allocate a larger table, mark all slots empty, and rehash. */
+
+    if ((v = (struct iset *) malloc(m * sizeof (struct iset))))
+    {
+        for (j = 0; j < m; ++j)
+            v[j].vi = -1;
+
+        for (i = 0; i < L->_hm; ++i)
+            if (L->_hv[i].vi >= 0)
+            {
+                j = (int) (hash_iset(L->_hv[i]._vi,
+                                     L->_hv[i]._ti,
+                                     L->_hv[i]._ni,
+                                     L->_hv[i]. gi) & (m - 1));
+
+                while (v[j].vi >= 0)
+                    j = (j + 1) & (m - 1);
+
+                v[j] = L->_hv[i];
+            }
+
+        free(L->_hv);
+
+        L->_hv = v;
+        L->_hm = m;
+
+        return 1;
+    }
+    return 0;
 }
 
-static int add_n(void)
+static struct iset *find_iset(struct obj_load *L, int _vi, int _ti,
+                                                  int _ni, int  gi)
 {
-    return add__((void **) &_nv, &_nc, &_nm, sizeof (struct vec3));
+    int i;
+
+    /* Keep the table at most half full, growing it as necessary. */
+
+    if (2 * (L->_hc + 1) > L->_hm && !grow_iset(L))
+        return NULL;
+
+    /* Probe linearly for the index set or the empty slot it belongs in. */
+
+    i = (int) (hash_iset(_vi, _ti, _ni, gi) & (L->_hm - 1));
+
+    while (L->_hv[i].vi >= 0)
+    {
+        if (L->_hv[i]._vi == _vi &&
+            L->_hv[i]._ti == _ti &&
+            L->_hv[i]._ni == _ni &&
+            L->_hv[i]. gi ==  gi)
+            return L->_hv + i;
+
+        i = (i + 1) & (L->_hm - 1);
+    }
+
+    /* Claim the empty slot for the caller to fill. */
+
+    L->_hc++;
+
+    return L->_hv + i;
 }
 
-static int add_i(void)
+static void free_lib(struct mtl_lib *);
+
+static void free_load(struct obj_load *L)
 {
-    return add__((void **) &_iv, &_ic, &_im, sizeof (struct iset));
+    int li;
+    int ui;
+
+    for (li = 0; li < L->_lc; ++li)
+        free_lib(L->_lv + li);
+    for (ui = 0; ui < L->_uh; ++ui)
+        free(L->_uv[ui].name);
+
+    free(L->_vv);
+    free(L->_tv);
+    free(L->_nv);
+    free(L->_iv);
+    free(L->_sv);
+    free(L->_hv);
+    free(L->_lv);
+    free(L->_dv);
+    free(L->_dt);
+    free(L->_uv);
+
+    L->_vv = NULL;
+    L->_tv = NULL;
+    L->_nv = NULL;
+    L->_iv = NULL;
+    L->_sv = NULL;
+    L->_hv = NULL;
+    L->_lv = NULL;
+    L->_dv = NULL;
+    L->_dt = NULL;
+    L->_uv = NULL;
+
+    L->_lc = 0;
+    L->_dc = 0;
+    L->_uh = 0;
 }
 
 /*============================================================================*/
@@ -270,2179 +666,7125 @@ static void normal(float *n, const float *a,
 }
 
 /*============================================================================*/
+/* Lexer                                                                      */
 
-#pragma pack(push, 1)
-struct tga_head
-{
-    unsigned char  id_length;
-    unsigned char  color_map_type;
-    unsigned char  image_type;
-    unsigned short color_map_offset;
-    unsigned short color_map_length;
-    unsigned char  color_map_size;
-    unsigned short image_x_origin;
-    unsigned short image_y_origin;
-    unsigned short image_width;
-    unsigned short image_height;
-    unsigned char  image_depth;
-    unsigned char  image_descriptor;
-};
-#pragma pack(pop)
+/* These scanners operate on a line delimited by pointers c and e. They do    */
+/* not require the line to be null-terminated, and advance c past whatever    */
+/* they consume. Number parsing requires only that the line be followed by a  */
+/* character that cannot continue a number, such as a newline or null.        */
 
-void *read_tga(const char *filename, int *w, int *h, int *d)
+static int is_space(char c)
 {
-    struct tga_head head;
-    FILE *stream;
-
-    if ((stream = fopen(filename, "rb")))
-    {
-        if (fread(&head, sizeof (struct tga_head), 1, stream) == 1)
-        {
-            if (head.image_type == 2)
-            {
-                *w = (int) head.image_width;
-                *h = (int) head.image_height;
-                *d = (int) head.image_depth;
+    return (c == ' ' || ('\t' <= c && c <= '\r'));
+}
 
-                if (fseek(stream, head.id_length, SEEK_CUR) == 0)
-                {
-                    size_t s = (*d) / 8;
-                    size_t n = (*w) * (*h);
-                    void *p;
+static const char *skip_space(const char *c, const char *e)
+{
+    while (c < e && is_space(c[0]))
+        c++;
+    return c;
+}
 
-                    if ((p = calloc(n, s)))
-                    {
-                        if (fread(p, s, n, stream) == n)
-                        {
-                            fclose(stream);
-                            return p;
-                        }
-                    }
-                }
-            }
-        }
-        fclose(stream);
-    }
-    return 0;
+static const char *skip_word(const char *c, const char *e)
+{
+    while (c < e && !is_space(c[0]))
+        c++;
+    return c;
 }
 
-unsigned int obj_load_image(const char *filename)
+static int scan_word(const char **c, const char *e, char *str)
 {
-    unsigned int o = 0;
+    const char *d = skip_space(*c, e);
+    const char *f = skip_word (d,  e);
 
-#ifndef CONF_NO_GL
-    if (filename)
-    {
-        int   w;
-        int   h;
-        int   d;
-        void *p;
+    size_t n = (size_t) (f - d);
 
-        /* Read the image data from the named file to a new pixel buffer. */
+    /* Copy the next white-space-delimited word, truncating to fit. */
 
-        if ((p = read_tga(filename, &w, &h, &d)))
-        {
-            /* Create an OpenGL texture object using these pixels. */
+    if (n > MAXSTR - 1)
+        n = MAXSTR - 1;
 
-            glGenTextures(1, &o);
-            glBindTexture(GL_TEXTURE_2D, o);
+    memcpy(str, d, n);
+    str[n] = '\0';
 
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    *c = f;
+    return (n > 0);
+}
 
-            if (d == 32)
-                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0,
-                             GL_BGRA, GL_UNSIGNED_BYTE, p);
-            if (d == 24)
-                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB,  w, h, 0,
-                             GL_BGR,  GL_UNSIGNED_BYTE, p);
+static int scan_int(const char **c, const char *e, int *i)
+{
+    const char *d = skip_space(*c, e);
 
-            glGenerateMipmap(GL_TEXTURE_2D);
+    int s = 0;
+    int n = 0;
 
-            /* Discard the unnecessary pixel buffer. */
+    /* Parse an optional sign followed by at least one decimal digit. */
 
-            free(p);
-        }
+    if (d < e && (d[0] == '-' || d[0] == '+'))
+        s = (*d++ == '-');
+
+    if (d < e && '0' <= d[0] && d[0] <= '9')
+    {
+        while (d < e && '0' <= d[0] && d[0] <= '9')
+            n = n * 10 + (*d++ - '0');
+
+        *i = s ? -n : n;
+        *c = d;
+        return 1;
     }
+    return 0;
+}
+
+/* Fixed-notation numbers are parsed exactly, without strtof, when the      */
+/* mantissa and power of ten are exact doubles and double arithmetic is not */
+/* carried out at extended precision. Everything else falls back to strtof. */
+
+#if defined(FLT_EVAL_METHOD) && FLT_EVAL_METHOD == 0
+#define SCAN_FAST
 #endif
 
-    return o;
+#ifdef SCAN_FAST
+static uint64_t load_eight(const char *c)
+{
+    const unsigned char *u = (const unsigned char *) c;
+
+    return ((uint64_t) u[0]      ) | ((uint64_t) u[1] <<  8)
+         | ((uint64_t) u[2] << 16) | ((uint64_t) u[3] << 24)
+         | ((uint64_t) u[4] << 32) | ((uint64_t) u[5] << 40)
+         | ((uint64_t) u[6] << 48) | ((uint64_t) u[7] << 56);
 }
 
-static void dirpath(char *pathname)
+static int is_eight_digits(uint64_t v)
 {
-    int i;
+    /* Determine whether all eight bytes are in '0' to '9'. */
 
-    /* Find the path by cutting a file name at the last directory delimiter. */
+    return (((v & 0xF0F0F0F0F0F0F0F0ull) |
+           (((v + 0x0606060606060606ull) & 0xF0F0F0F0F0F0F0F0ull) >> 4))
+                                        == 0x3333333333333333ull);
+}
 
-    for (i = (int) strlen(pathname) - 1; i >= 0; --i)
-        if (pathname[i] == '/' || pathname[i] == '\\')
-        {
-            pathname[i] = '\0';
-            return;
-        }
+static uint64_t eight_digits(uint64_t v)
+{
+    /* Combine eight digits pairwise into one value, first digit highest. */
 
-    /* If no delimiter was found, return the current directory. */
+    v = ((v & 0x0F0F0F0F0F0F0F0Full) *          2561) >>  8;
+    v = ((v & 0x00FF00FF00FF00FFull) *       6553601) >> 16;
+    v = ((v & 0x0000FFFF0000FFFFull) * 42949672960001ull) >> 32;
 
-    strcpy(pathname, ".");
+    return v;
 }
 
-/*----------------------------------------------------------------------------*/
-
-static void read_image(obj *O, int mi, int ki, const char *line,
-                                               const char *path)
+static const char *scan_digits(const char *c, const char *e, uint64_t *w)
 {
-    unsigned int clamp  = 0;
+    uint64_t v;
 
-    float o[3] = { 0.0f, 0.0f, 0.0f };
-    float s[3] = { 1.0f, 1.0f, 1.0f };
+    /* Accumulate decimal digits, eight at a time while possible. */
 
-    char pathname[MAXSTR];
+    while (e - c >= 8 && is_eight_digits(v = load_eight(c)))
+    {
+        *w = *w * 100000000 + eight_digits(v);
+        c += 8;
+    }
+    while (c < e && '0' <= c[0] && c[0] <= '9')
+        *w = *w * 10 + (uint64_t) (*c++ - '0');
 
-    char map[MAXSTR];
-    char val[MAXSTR];
+    return c;
+}
 
-    const char *end;
+static int scan_float_fast(const char **c, const char *e, float *f)
+{
+    static const double p[23] = {
+        1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
 
-    memset(map, 0, MAXSTR);
-    memset(val, 0, MAXSTR);
+    const char *d = *c;
+    const char *a;
+    const char *b;
+
+    uint64_t w = 0;
+    uint64_t u;
+    double   x;
+    int      n;
+    int      k = 0;
+    int      s = 0;
 
-    while (line[0] != '\0' && line[0] != '\r' && line[0] != '\n')
+    /* Parse a sign, integer digits, and fraction digits. */
+
+    if (d < e && (d[0] == '-' || d[0] == '+'))
+        s = (*d++ == '-');
+
+    a = d;
+    b = d = scan_digits(d, e, &w);
+    n = (int) (b - a);
+
+    if (d < e && d[0] == '.')
     {
-        int n = 0;
+        d  = scan_digits(d + 1, e, &w);
+        k  = (int) (d - b) - 1;
+        n += k;
+    }
 
-        while(isspace(line[0])) line++;
+    /* Defer exponents, hex, inf, nan, and over-long mantissas to strtof. */
 
-        /* Parse property map options. */
+    if (n < 1 || n > 19 || w > (1ull << 53) || k > 22)
+        return 0;
+    if (d < e && (d[0] == 'e' || d[0] == 'E' || d[0] == 'x' || d[0] == 'X'))
+        return 0;
 
-        if (sscanf(line, "-clamp %s%n", val, &n) >= 1)
-        {
-            clamp  = (strcmp(val, "on") == 0) ? OBJ_OPT_CLAMP : 0;
-            line  += n;
-        }
+    /* Divide exactly-represented values for a correctly rounded double. */
+
+    x = (double) w / p[k];
 
-        /* Parse property map scale. */
+    /* Rounding that double to float is exact unless it falls on a tie. */
 
-        else if (sscanf(line, "-s %f %f %f%n", s + 0, s + 1, s + 2, &n) >= 3)
-            line += n;
-        else if (sscanf(line, "-s %f %f%n",    s + 0, s + 1,        &n) >= 2)
-            line += n;
-        else if (sscanf(line, "-s %f%n",       s + 0,               &n) >= 1)
-            line += n;
+    if (x != 0.0)
+    {
+        if (x < FLT_MIN || x > FLT_MAX)
+            return 0;
 
-        /* Parse property map offset. */
+        memcpy(&u, &x, sizeof (double));
 
-        else if (sscanf(line, "-o %f %f %f%n", o + 0, o + 1, o + 2, &n) >= 3)
-            line += n;
-        else if (sscanf(line, "-o %f %f%n",    o + 0, o + 1,        &n) >= 2)
-            line += n;
-        else if (sscanf(line, "-o %f%n",       o + 0,               &n) >= 1)
-            line += n;
+        if ((u & 0x1FFFFFFF) == 0x10000000)
+            return 0;
+    }
 
-        /* Check for a file name */
+    *f = (float) (s ? -x : x);
+    *c = d;
+    return 1;
+}
+#endif
 
-        else if ((end = strstr(line, ".tga"))) { strncpy(map, line, end - line + 4); break; }
-        else if ((end = strstr(line, ".TGA"))) { strncpy(map, line, end - line + 4); break; }
+static int scan_float(const char **c, const char *e, float *f)
+{
+    const char *d = skip_space(*c, e);
+    char       *g;
 
-        /* If we see something we don't recognize, stop looking. */
+    /* Parse a floating point number, as would scanf. */
 
-        else break;
+    if (d < e)
+    {
+        float k;
+
+#ifdef SCAN_FAST
+        if (scan_float_fast(&d, e, f))
+        {
+            *c = d;
+            return 1;
+        }
+#endif
+        k = strtof(d, &g);
+
+        if (g > d)
+        {
+            *f = k;
+            *c = g;
+            return 1;
+        }
     }
+    return 0;
+}
 
-    /* Apply all parsed property attributes to the material. */
+static int scan_floats(const char **c, const char *e, float *f, int n)
+{
+    int i;
 
-    sprintf(pathname, "%s/%s", path, map);
+    /* Parse up to n numbers, leaving any that are not present unchanged. */
 
-    obj_set_mtrl_opt(O, mi, ki, clamp);
-    obj_set_mtrl_map(O, mi, ki, pathname);
-    obj_set_mtrl_o  (O, mi, ki, o);
-    obj_set_mtrl_s  (O, mi, ki, s);
+    for (i = 0; i < n; ++i)
+        if (!scan_float(c, e, f + i))
+            break;
+
+    return i;
 }
 
-static void read_color(obj *O, int mi, int ki, const char *line)
+static int is_word(const char *c, const char *d, const char *str)
 {
-    float c[4];
+    size_t n = strlen(str);
 
-    /* Merge incoming color components with existing defaults. */
+    /* Determine whether the word from c to d is the given string. */
 
-    obj_get_mtrl_c(O, mi, ki, c);
-    sscanf(line, "%f %f %f", c, c + 1, c + 2);
-    obj_set_mtrl_c(O, mi, ki, c);
+    return ((size_t) (d - c) == n && memcmp(c, str, n) == 0);
 }
 
-static void read_alpha(obj *O, int mi, int ki, const char *line)
+static const char *find_str(const char *c, const char *e, const char *str)
 {
-    float c[4];
-    float t;
+    size_t n = strlen(str);
 
-    /* Merge incoming color components with existing defaults. */
+    /* Find the first occurrence of the given string between c and e. */
 
-    obj_get_mtrl_c(O, mi, ki, c);
-    sscanf(line, "%f", &t);
-    c[3] = 1.0 - t;
-    obj_set_mtrl_c(O, mi, ki, c);
+    for (; c + n <= e; ++c)
+        if (c[0] == str[0] && memcmp(c, str, n) == 0)
+            return c;
+
+    return NULL;
 }
 
-static void read_mtl(const char *path,
-                     const char *file,
-                     const char *name, obj *O, int mi)
+static unsigned int hash_name(const char *name, size_t n)
 {
-    char pathname[MAXSTR];
+    unsigned int h = 2166136261u;
 
-    char buf[MAXSTR];
-    char key[MAXSTR];
-    char arg[MAXSTR];
+    while (n--)
+        h = (h ^ (unsigned char) *name++) * 16777619u;
 
-    FILE *fin;
+    return h;
+}
+
+/*============================================================================*/
 
-    int scanning = 1;
-    int n        = 0;
+#pragma pack(push, 1)
+struct tga_head
+{
+    unsigned char  id_length;
+    unsigned char  color_map_type;
+    unsigned char  image_type;
+    unsigned short color_map_offset;
+    unsigned short color_map_length;
+    unsigned char  color_map_size;
+    unsigned short image_x_origin;
+    unsigned short image_y_origin;
+    unsigned short image_width;
+    unsigned short image_height;
+    unsigned char  image_depth;
+    unsigned char  image_descriptor;
+};
+#pragma pack(pop)
 
-    sprintf(pathname, "%s/%s", path, file);
+void *read_tga(const char *filename, int *w, int *h, int *d)
+{
+    struct tga_head head;
+    FILE *stream;
 
-    if ((fin = fopen(pathname, "r")))
+    if ((stream = fopen(filename, "rb")))
     {
-        /* Process each line of the MTL file. */
-
-        while  (fgets (buf, MAXSTR, fin))
-            if (sscanf(buf, "%s%n", key, &n) >= 1)
+        if (fread(&head, sizeof (struct tga_head), 1, stream) == 1)
+        {
+            if (head.image_type == 2)
             {
-                const char *c = buf + n;
+                *w = (int) head.image_width;
+                *h = (int) head.image_height;
+                *d = (int) head.image_depth;
 
-                if (scanning)
+                if (fseek(stream, head.id_length, SEEK_CUR) == 0)
                 {
-                    /* Determine if we've found the MTL we're looking for. */
+                    size_t s = (*d) / 8;
+                    size_t n = (*w) * (*h);
+                    void *p;
 
-                    if (!strcmp(key, "newmtl"))
+                    if ((p = calloc(n, s)))
                     {
-                        sscanf(c, "%s", arg);
-
-                        if ((scanning = strcmp(arg, name)) == 0)
-                            obj_set_mtrl_name(O, mi, name);
+                        if (fread(p, s, n, stream) == n)
+                        {
+                            fclose(stream);
+                            return p;
+                        }
                     }
                 }
-                else
-                {
-                    /* Stop scanning when the next MTL begins. */
-
-                    if (!strcmp(key, "newmtl"))
-                        break;
-
-                    /* Parse this material's properties. */
-
-                    else if (!strcmp(key, "map_Kd"))
-                        read_image(O, mi, OBJ_KD, c, path);
-                    else if (!strcmp(key, "map_Ka"))
-                        read_image(O, mi, OBJ_KA, c, path);
-                    else if (!strcmp(key, "map_Ke"))
-                        read_image(O, mi, OBJ_KE, c, path);
-                    else if (!strcmp(key, "map_Ks"))
-                        read_image(O, mi, OBJ_KS, c, path);
-                    else if (!strcmp(key, "map_Ns"))
-                        read_image(O, mi, OBJ_NS, c, path);
-                    else if (!strcmp(key, "map_Kn"))
-                        read_image(O, mi, OBJ_KN, c, path);
-
-                    else if (!strcmp(key, "Kd"))
-                        read_color(O, mi, OBJ_KD, c);
-                    else if (!strcmp(key, "Ka"))
-                        read_color(O, mi, OBJ_KA, c);
-                    else if (!strcmp(key, "Ke"))
-                        read_color(O, mi, OBJ_KE, c);
-                    else if (!strcmp(key, "Ks"))
-                        read_color(O, mi, OBJ_KS, c);
-                    else if (!strcmp(key, "Ns"))
-                        read_color(O, mi, OBJ_NS, c);
-
-                    else if (!strcmp(key, "d"))
-                        read_alpha(O, mi, OBJ_KD, c);
-                    else if (!strcmp(key, "Tr"))
-                        read_alpha(O, mi, OBJ_KD, c);
-                }
             }
-        fclose(fin);
+        }
+        fclose(stream);
     }
+    return 0;
 }
 
-static void read_mtllib(char *file, const char *line)
+#ifndef CONF_NO_GL
+static unsigned int make_texture(int w, int h, int d, const void *p)
 {
-    /* Parse the first file name from the given line. */
+    unsigned int o = 0;
+
+    /* Create an OpenGL texture object using the given pixels. */
+
+    glGenTextures(1, &o);
+    glBindTexture(GL_TEXTURE_2D, o);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+
+    if (d == 32)
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0,
+                     GL_BGRA, GL_UNSIGNED_BYTE, p);
+    if (d == 24)
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB,  w, h, 0,
+                     GL_BGR,  GL_UNSIGNED_BYTE, p);
 
-    sscanf(line, "%s", file);
+    glGenerateMipmap(GL_TEXTURE_2D);
+
+    return o;
 }
+#endif
 
-static int read_usemtl(const char *path,
-                       const char *file,
-                       const char *line, obj *O)
+static void *read_tga_buffer(const char *buf, size_t len,
+                             int *w, int *h, int *d)
 {
-    char name[MAXSTR];
+    struct tga_head head;
 
-    int si;
-    int mi;
+    /* Decode a Targa image from memory, as read_tga would from a file. */
+
+    if (len >= sizeof (struct tga_head))
+    {
+        memcpy(&head, buf, sizeof (struct tga_head));
+
+        if (head.image_type == 2)
+        {
+            size_t o = sizeof (struct tga_head) + head.id_length;
+            size_t s = head.image_depth / 8;
+            size_t n = (size_t) head.image_width * head.image_height;
+            void  *p;
 
-    sscanf(line, "%s", name);
+            *w = (int) head.image_width;
+            *h = (int) head.image_height;
+            *d = (int) head.image_depth;
 
-    /* Create a new material for the incoming definition. */
+            if (o + s * n <= len && (p = calloc(n, s)))
+            {
+                memcpy(p, buf + o, s * n);
+                return p;
+            }
+        }
+    }
+    return 0;
+}
+
+unsigned int obj_load_image(const char *filename)
+{
+    unsigned int o = 0;
 
-    if ((mi = obj_add_mtrl(O)) >= 0)
+#ifndef CONF_NO_GL
+    if (filename)
     {
-        /* Create a new surface to contain geometry with the new material. */
+        int   w;
+        int   h;
+        int   d;
+        void *p;
 
-        if ((si = obj_add_surf(O)) >= 0)
-        {
-            /* Read the material definition and apply it to the new surface. */
+        /* Read the image data from the named file to a new pixel buffer. */
 
-            read_mtl(path, file, name, O, mi);
-            obj_set_surf(O, si, mi);
+        if ((p = read_tga(filename, &w, &h, &d)))
+        {
+            o = make_texture(w, h, d, p);
 
-            /* Return the surface so that new geometry may be added to it. */
+            /* Discard the unnecessary pixel buffer. */
 
-            return si;
+            free(p);
         }
     }
+#endif
 
-    /* On failure, return the default surface. */
-
-    return 0;
+    return o;
 }
 
 /*----------------------------------------------------------------------------*/
 
-static int read_poly_indices(const char *line, int *_vi, int *_ti, int *_ni)
-{
-    int n;
+/* Material images are shared through a process-wide cache keyed by file    */
+/* identity, so each image file is decoded and uploaded only once, whatever */
+/* path names it. Each entry counts its users and is released when the last */
+/* one lets it go.                                                          */
 
-    *_vi = 0;
-    *_ti = 0;
-    *_ni = 0;
+#define IMGTAB 256
 
-    /* Parse a face vertex specification from the given line. */
+struct obj_image
+{
+    struct obj_image *next;     /* Next image in the same bucket        */
 
-    if (sscanf(line, "%d/%d/%d%n", _vi, _ti, _ni, &n) >= 3) return n;
-    if (sscanf(line, "%d/%d%n",    _vi, _ti,      &n) >= 2) return n;
-    if (sscanf(line, "%d//%d%n",   _vi,      _ni, &n) >= 2) return n;
-    if (sscanf(line, "%d%n",       _vi,           &n) >= 1) return n;
+    char  *path;                /* Path name of the image file          */
+    dev_t  dev;                 /* Device holding the image file        */
+    ino_t  ino;                 /* Inode of the image file              */
+    time_t mtime;               /* Modification time of the image file  */
 
-    return 0;
-}
+    void  *p;                   /* Decoded pixels, until uploaded       */
+    int    w, h, d;             /* Image width, height, and depth       */
+    int    refs;                /* Number of users of this image        */
 
-static int read_poly_vertices(const char *line, obj *O, int gi)
-{
-    const char *c = line;
+    unsigned int o;             /* Texture object, or a serial without GL */
+};
 
-    int _vi;
-    int _ti;
-    int _ni;
-    int _ii;
-    int _ij;
+static struct obj_image *image_cache[IMGTAB];
 
-    int  dc;
-    int  vi;
-    int  ic = 0;
+#ifdef CONF_NO_GL
+static unsigned int      image_count;
+#endif
 
-    /* Scan the face string, converting index sets to vertices. */
+#ifndef CONF_NO_THREADS
+static pthread_mutex_t   image_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
 
-    while ((dc = read_poly_indices(c, &_vi, &_ti, &_ni)))
-    {
-        /* Convert face indices to vector cache indices. */
+static void lock_images(void)
+{
+#ifndef CONF_NO_THREADS
+    pthread_mutex_lock(&image_mutex);
+#endif
+}
+
+static void unlock_images(void)
+{
+#ifndef CONF_NO_THREADS
+    pthread_mutex_unlock(&image_mutex);
+#endif
+}
 
-        _vi += (_vi < 0) ? _vc : -1;
-        _ti += (_ti < 0) ? _tc : -1;
-        _ni += (_ni < 0) ? _nc : -1;
+static unsigned int image_bucket(const char *path, dev_t dev, ino_t ino)
+{
+#ifdef _WIN32
+    /* Windows reports no inode numbers, so only the path identifies a file. */
 
-        /* Initialize a new index set. */
+    (void) dev;
+    (void) ino;
 
-        if ((_ii = add_i()) >= 0)
-        {
-            _iv[_ii]._vi = _vi;
-            _iv[_ii]._ni = _ni;
-            _iv[_ii]._ti = _ti;
+    return hash_name(path, strlen(path)) % IMGTAB;
+#else
+    (void) path;
 
-            /* Search the vector reference list for a repeated index set. */
+    return (unsigned int) (((unsigned long) ino * 0x9E3779B1u) ^
+                            (unsigned long) dev) % IMGTAB;
+#endif
+}
 
-            for (_ij = _vv[_vi]._ii; _ij >= 0; _ij = _iv[_ij]._ii)
-                if (_iv[_ij]._vi == _vi &&
-                    _iv[_ij]._ti == _ti &&
-                    _iv[_ij]._ni == _ni &&
-                    _iv[_ij]. gi ==  gi)
-                {
-                    /* A repeat has been found. Link new to old. */
+static struct obj_image *find_image(const char *path, const struct stat *st)
+{
+    struct obj_image *I = image_cache[image_bucket(path, st->st_dev,
+                                                         st->st_ino)];
 
-                    _vv[_vi]._ii = _ii;
-                    _iv[_ii]._ii = _ij;
-                    _iv[_ii]. vi = _iv[_ij].vi;
-                    _iv[_ii]. gi = _iv[_ij].gi;
+    /* Find a cached image of the given file, counting a new reference. */
 
-                    break;
-                }
+    for (; I; I = I->next)
+        if (I->ino   == st->st_ino   &&
+            I->dev   == st->st_dev   &&
+            I->mtime == st->st_mtime)
+        {
+#ifdef _WIN32
+            if (strcmp(I->path, path))
+                continue;
+#endif
+            I->refs++;
+            return I;
+        }
 
-            /* If no repeat was found, add a new vertex. */
+    return NULL;
+}
 
-            if ((_ij < 0) && (vi = obj_add_vert(O)) >= 0)
-            {
-                _vv[_vi]._ii = _ii;
-                _iv[_ii]._ii =  -1;
-                _iv[_ii]. vi =  vi;
-                _iv[_ii]. gi =  gi;
+static struct obj_image *new_image(const char *path, void *p,
+                                   int w, int h, int d)
+{
+    struct obj_image *I;
 
-                /* Initialize the new vertex using valid cache references. */
+    /* Create an image with one reference. Call with the cache locked. */
 
-                if (0 <= _vi && _vi < _vc) obj_set_vert_v(O, vi, _vv[_vi].v);
-                if (0 <= _ni && _ni < _nc) obj_set_vert_n(O, vi, _nv[_ni].v);
-                if (0 <= _ti && _ti < _tc) obj_set_vert_t(O, vi, _tv[_ti].v);
-            }
-            ic++;
+    if ((I = (struct obj_image *) calloc(1, sizeof (struct obj_image))))
+    {
+        if ((I->path = (char *) malloc(strlen(path) + 1)))
+        {
+            strcpy(I->path, path);
+
+            I->w    = w;
+            I->h    = h;
+            I->d    = d;
+            I->p    = p;
+            I->refs = 1;
+#ifdef CONF_NO_GL
+            I->o    = ++image_count;
+#endif
+            return I;
         }
-        c  += dc;
+        free(I);
     }
-    return ic;
+    free(p);
+    return NULL;
 }
 
-static void read_f(const char *line, obj *O, int si, int gi)
+static struct obj_image *get_image(const char *path)
 {
-    float n[3];
-    float t[3];
-    int i, pi;
+    struct obj_image *I = NULL;
+    struct stat       st;
 
-    /* Create new vertex references for this face. */
+    int   w;
+    int   h;
+    int   d;
+    void *p;
 
-    int i0 = _ic;
-    int ic = read_poly_vertices(line, O, gi);
+    /* Only regular files are images. */
 
-    /* If smoothing, apply this face's normal to vertices that need it. */
+    if (path == NULL || stat(path, &st) != 0
+                     || (st.st_mode & S_IFMT) != S_IFREG)
+        return NULL;
 
-    if (gi)
-    {
-        normal(n, _vv[_iv[i0 + 0]._vi].v,
-                  _vv[_iv[i0 + 1]._vi].v,
-                  _vv[_iv[i0 + 2]._vi].v);
+    /* Return the cached image, if any. */
 
-        for (i = 0; i < ic; ++i)
-            if (_iv[i0 + 0]._ni < 0)
-            {
-                obj_get_vert_n(O, _iv[i0 + i]._vi, t);
-                t[0] += n[0];
-                t[1] += n[1];
-                t[2] += n[2];
-                obj_set_vert_n(O, _iv[i0 + i]._vi, t);
-            }
-    }
+    lock_images();
+    I = find_image(path, &st);
+    unlock_images();
 
-    /* Convert our N new vertex references into N-2 new triangles. */
+    if (I) return I;
 
-    for (i = 0; i < ic - 2; ++i)
+    /* Decode the image outside of the lock, as this may take a while. */
+    /* Without GL the pixels would never be used, so only the entry is  */
+    /* made.                                                            */
 
-        if ((pi = obj_add_poly(O, si)) >= 0)
-        {
-            int vi[3];
+#ifdef CONF_NO_GL
+    p = NULL;
+    w = 0;
+    h = 0;
+    d = 0;
+#else
+    if ((p = read_tga(path, &w, &h, &d)) == NULL)
+        return NULL;
+#endif
 
-            vi[0] = _iv[i0        ].vi;
-            vi[1] = _iv[i0 + i + 1].vi;
-            vi[2] = _iv[i0 + i + 2].vi;
+    lock_images();
 
-            obj_set_poly(O, si, pi, vi);
-        }
-}
+    /* If another thread has cached the image in the meantime, use it. */
 
-/*----------------------------------------------------------------------------*/
+    if ((I = find_image(path, &st)))
+        free(p);
 
-static int read_line_indices(const char *line, int *_vi, int *_ti)
-{
-    int n;
+    /* Otherwise, cache a new image. */
 
-    *_vi = 0;
-    *_ti = 0;
+    else if ((I = new_image(path, p, w, h, d)))
+    {
+        unsigned int b = image_bucket(path, st.st_dev, st.st_ino);
 
-    /* Parse a line vertex specification from the given line. */
+        I->dev   = st.st_dev;
+        I->ino   = st.st_ino;
+        I->mtime = st.st_mtime;
+        I->next  = image_cache[b];
 
-    if (sscanf(line, "%d/%d%n", _vi, _ti, &n) >= 2) return n;
-    if (sscanf(line, "%d%n",    _vi,      &n) >= 1) return n;
+        image_cache[b] = I;
+    }
 
-    return 0;
+    unlock_images();
+
+    return I;
 }
 
-static int read_line_vertices(const char *line, obj *O)
+static unsigned int bind_image(struct obj_image *I)
 {
-    const char *c = line;
-
-    int _vi;
-    int _ti;
-    int _ii;
-    int _ij;
-
-    int  dc;
-    int  vi;
-    int  ic = 0;
+    unsigned int o;
 
-    /* Scan the line string, converting index sets to vertices. */
+    /* Upload the image on first use in a GL context, releasing its pixels. */
 
-    while ((dc = read_line_indices(c, &_vi, &_ti)))
+    lock_images();
+#ifndef CONF_NO_GL
+    if (I->o == 0 && I->p)
     {
-        /* Convert line indices to vector cache indices. */
-
-        _vi += (_vi < 0) ? _vc : -1;
-        _ti += (_ti < 0) ? _tc : -1;
+        I->o = make_texture(I->w, I->h, I->d, I->p);
+        free(I->p);
+        I->p = NULL;
+    }
+#endif
+    o = I->o;
+    unlock_images();
 
-        /* Initialize a new index set. */
+    return o;
+}
 
-        if ((_ii = add_i()) >= 0)
-        {
-            _iv[_ii]._vi = _vi;
-            _iv[_ii]._ti = _ti;
+static void put_image(struct obj_image *I)
+{
+    struct obj_image **J;
 
-            /* Search the vector reference list for a repeated index set. */
+    int r = 1;
 
-            for (_ij = _vv[_vi]._ii; _ij >= 0; _ij = _iv[_ij]._ii)
-                if (_iv[_ij]._vi == _vi &&
-                    _iv[_ij]._ti == _ti)
-                {
-                    /* A repeat has been found. Link new to old. */
+    /* Drop a reference, unlinking the image if it was the last. */
 
-                    _vv[_vi]._ii = _ii;
-                    _iv[_ii]._ii = _ij;
-                    _iv[_ii]. vi = _iv[_ij].vi;
+    if (I)
+    {
+        lock_images();
 
+        if ((r = --I->refs) == 0)
+            for (J = image_cache + image_bucket(I->path, I->dev, I->ino);
+                                                   *J; J = &(*J)->next)
+                if (*J == I)
+                {
+                    *J = I->next;
                     break;
                 }
 
-            /* If no repeat was found, add a new vertex. */
-
-            if ((_ij < 0) && (vi = obj_add_vert(O)) >= 0)
-            {
-                _vv[_vi]._ii = _ii;
-                _iv[_ii]._ii =  -1;
-                _iv[_ii]. vi =  vi;
+        unlock_images();
 
-                /* Initialize the new vertex using valid cache references. */
+        /* Release the unlinked image. */
 
-                if (0 <= _vi && _vi < _vc) obj_set_vert_v(O, vi, _vv[_vi].v);
-                if (0 <= _ti && _ti < _tc) obj_set_vert_t(O, vi, _tv[_ti].v);
-            }
-            ic++;
+        if (r == 0)
+        {
+#ifndef CONF_NO_GL
+            if (I->o) glDeleteTextures(1, &I->o);
+#endif
+            free(I->path);
+            free(I->p);
+            free(I);
         }
-        c  += dc;
     }
-    return ic;
 }
 
-static void read_l(const char *line, obj *O, int si)
+static void set_map(obj *O, int mi, int ki, const char *str,
+                                            struct obj_image *I)
 {
-    int i, li;
+    /* Release any current image and take over the given reference. */
 
-    /* Create new vertices for this line. */
+    put_image(O->mv[mi].kv[ki].img);
 
-    int i0 = _ic;
-    int ic = read_line_vertices(line, O);
+    O->mv[mi].kv[ki].img = I;
+    O->mv[mi].kv[ki].map = 0;
+    O->mv[mi].kv[ki].str = set_name(O->mv[mi].kv[ki].str, str);
+}
 
-    /* Convert our N new vertices into N-1 new lines. */
+static void bind_map(obj *O, int mi, int ki)
+{
+    struct obj_prop *kp = O->mv[mi].kv + ki;
 
-    for (i = 0; i < ic - 1; ++i)
+    /* Give a property its texture, if it has an image not yet bound. */
 
-        if ((li = obj_add_line(O, si)) >= 0)
-        {
-            int vi[2];
+    if (kp->img && kp->map == 0)
+        kp->map = bind_image(kp->img);
+}
+
+static void dirpath(char *pathname)
+{
+    int i;
 
-            vi[0] = _iv[i0 + i    ].vi;
-            vi[1] = _iv[i0 + i + 1].vi;
+    /* Find the path by cutting a file name at the last directory delimiter. */
 
-            obj_set_line(O, si, li, vi);
+    for (i = (int) strlen(pathname) - 1; i >= 0; --i)
+        if (pathname[i] == '/' || pathname[i] == '\\')
+        {
+            pathname[i] = '\0';
+            return;
         }
+
+    /* If no delimiter was found, return the current directory. */
+
+    strcpy(pathname, ".");
 }
 
 /*----------------------------------------------------------------------------*/
 
-static void read_v(const char *line)
+typedef int (*read_func)(void *, const char *, const char *);
+
+static const char *read_lines(read_func func, void *data, const char *c,
+                                                          const char *e)
 {
-    int _vi;
+    const char *d;
 
-    /* Parse a vertex position. */
+    /* Process each complete line, returning the start of any remainder. */
 
-    if ((_vi = add_v()) >= 0)
+    while ((d = (const char *) memchr(c, '\n', e - c)))
     {
-        sscanf(line, "%f %f %f", _vv[_vi].v + 0,
-                                 _vv[_vi].v + 1,
-                                 _vv[_vi].v + 2);
-        _vv[_vi]._ii = -1;
+        if (func(data, c, d))
+            return NULL;
+
+        c = d + 1;
     }
+    return c;
 }
 
-static void read_vt(const char *line)
+static int read_last(read_func func, void *data, const char *c,
+                                                 const char *e)
 {
-    int _ti;
+    char *buf;
+    int   r = 0;
 
-    /* Parse a texture coordinate. */
+    /* Process an unterminated final line from a null-terminated copy. */
 
-    if ((_ti = add_t()) >= 0)
+    if (c < e && (buf = (char *) malloc(e - c + 1)))
     {
-        sscanf(line, "%f %f", _tv[_ti].v + 0,
-                              _tv[_ti].v + 1);
-        _tv[_ti]._ii = -1;
+        memcpy(buf, c, e - c);
+        buf[e - c] = '\0';
+
+        r = func(data, buf, buf + (e - c));
+        free(buf);
     }
+    return r;
 }
 
-static void read_vn(const char *line)
+#ifndef CONF_NO_MMAP
+static int map_file(const char *filename, char **p, size_t *n)
 {
-    int _ni;
+    struct stat st;
 
-    /* Parse a normal. */
+    void *v;
+    int   fd;
+    int   r = 0;
+
+    /* Map the named file for sequential reading. */
 
-    if ((_ni = add_n()) >= 0)
+    if ((fd = open(filename, O_RDONLY)) >= 0)
     {
-        sscanf(line, "%f %f %f", _nv[_ni].v + 0,
-                                 _nv[_ni].v + 1,
-                                 _nv[_ni].v + 2);
-        _nv[_ni]._ii = -1;
+        if (fstat(fd, &st) == 0)
+        {
+            *p = NULL;
+            *n = (size_t) st.st_size;
+
+            if (*n == 0)
+                r = 1;
+
+            else if ((v = mmap(NULL, *n, PROT_READ, MAP_PRIVATE, fd, 0))
+                                                              != MAP_FAILED)
+            {
+                madvise(v, *n, MADV_SEQUENTIAL);
+
+                *p = (char *) v;
+                r  = 1;
+            }
+        }
+        close(fd);
     }
+    return r;
 }
 
-/*----------------------------------------------------------------------------*/
+static void unmap_file(char *p, size_t n)
+{
+    if (p) munmap(p, n);
+}
 
-static void read_obj(obj *O, const char *filename)
+static int read_file_mapped(const char *filename, read_func func, void *data)
 {
-    char buf[MAXSTR];
-    char key[MAXSTR];
+    const char *c;
+    char       *p;
+    size_t      n;
 
-    char L[MAXSTR];
-    char D[MAXSTR];
+    /* Map the named file and process its lines in place. */
 
-    FILE *fin;
+    if (map_file(filename, &p, &n))
+    {
+        if (p && (c = read_lines(func, data, p, p + n)))
+            read_last(func, data, c, p + n);
+
+        unmap_file(p, n);
+        return 1;
+    }
+    return 0;
+}
+#endif
 
-    /* Flush the vector caches. */
+static int load_file(const char *filename, char **p, size_t *n)
+{
+    FILE *fin;
+    long  k;
+    int   r = 0;
 
-    _vc = 0;
-    _tc = 0;
-    _nc = 0;
-    _ic = 0;
+    /* Read the entire named file into a new null-terminated buffer. */
 
-    /* Add the named file to the given object. */
+    if ((fin = fopen(filename, "rb")))
+    {
+        if (fseek(fin, 0, SEEK_END) == 0 && (k = ftell(fin)) >= 0
+                                         && fseek(fin, 0, SEEK_SET) == 0)
+        {
+            if ((*p = (char *) malloc((size_t) k + 1)))
+            {
+                *n = fread(*p, 1, (size_t) k, fin);
+                (*p)[*n] = '\0';
+                r = 1;
+            }
+        }
+        fclose(fin);
+    }
+    return r;
+}
 
-    if ((fin = fopen(filename, "r")))
+static void free_lib(struct mtl_lib *B)
+{
+#ifndef CONF_NO_MMAP
+    if (B->mapped)
     {
-        /* Ensure there exists a default surface 0 and default material 0. */
+        unmap_file(B->p, B->n);
+        return;
+    }
+#endif
+    free(B->p);
+}
 
-        int si = obj_add_surf(O);
-        int mi = obj_add_mtrl(O);
-        int gi = 0;
-        int n;
+static int read_file(const char *filename, unsigned int opt,
+                     read_func func, void *data)
+{
+    FILE *fin;
 
-        obj_set_surf(O, si, mi);
+    size_t m = MAXBUF;
+    size_t n = 0;
+    size_t k;
 
-        /* Extract the directory from the filename for use in MTL loading. */
+    char *buf;
+    char *tmp;
 
-        strncpy(D, filename, MAXSTR);
-        dirpath(D);
+#ifndef CONF_NO_MMAP
+    if (opt & OBJ_READ_MMAP)
+        return read_file_mapped(filename, func, data);
+#endif
 
-        /* Process each line of the OBJ file, invoking the handler for each. */
+    if ((fin = fopen(filename, "rb")))
+    {
+        /* Read the file in large blocks, processing each complete line. */
 
-        while  (fgets (buf, MAXSTR, fin))
-            if (sscanf(buf, "%s%n", key, &n) >= 1)
+        if ((buf = (char *) malloc(m + 1)))
+        {
+            while ((k = fread(buf + n, 1, m - n, fin)) > 0)
             {
-                const char *c = buf + n;
+                const char *c = read_lines(func, data, buf, buf + n + k);
+
+                if (c == NULL)
+                {
+                    n = 0;
+                    break;
+                }
+
+                /* Carry any partial line over to the next block. */
 
-                if      (!strcmp(key, "f" )) read_f (c, O, si, gi);
-                else if (!strcmp(key, "l" )) read_l (c, O, si);
-                else if (!strcmp(key, "vt")) read_vt(c);
-                else if (!strcmp(key, "vn")) read_vn(c);
-                else if (!strcmp(key, "v" )) read_v (c);
+                n = (size_t) (buf + n + k - c);
+                memmove(buf, c, n);
 
-                else if (!strcmp(key, "mtllib"))      read_mtllib(   L, c   );
-                else if (!strcmp(key, "usemtl")) si = read_usemtl(D, L, c, O);
-                else if (!strcmp(key, "s"     )) gi = atoi(c);
+                /* Grow the buffer if a single line fills it. */
+
+                if (n == m)
+                {
+                    if ((tmp = (char *) realloc(buf, 2 * m + 1)))
+                    {
+                        buf = tmp;
+                        m   = 2 * m;
+                    }
+                    else break;
+                }
             }
 
+            /* Process any unterminated final line. */
+
+            read_last(func, data, buf, buf + n);
+            free(buf);
+        }
         fclose(fin);
+        return 1;
     }
+    return 0;
 }
 
 /*----------------------------------------------------------------------------*/
 
-static void obj_rel_mtrl(struct obj_mtrl *mp)
+static void dep_rec(char *rec, const char *path)
 {
-    /* Release any resources held by this material. */
+    struct stat st;
 
-    int ki;
+    /* Describe a file by size and modification time, or as missing. */
 
-    for (ki = 0; ki < OBJ_PROP_COUNT; ki++)
-    {
-        if (mp->kv[ki].str) free(mp->kv[ki].str);
-#ifndef CONF_NO_GL
-        if (mp->kv[ki].map) glDeleteTextures(1, &mp->kv[ki].map);
-#endif
-    }
+    if (stat(path, &st) == 0)
+        sprintf(rec, "%lu %lu %s\n", (unsigned long) st.st_size,
+                                     (unsigned long) st.st_mtime, path);
+    else
+        sprintf(rec, "- - %s\n", path);
 }
 
-static void obj_rel_surf(struct obj_surf *sp)
+static char *add_dep(char *dep, const char *path)
 {
-#ifndef CONF_NO_GL
-    if (sp->pibo) glDeleteBuffers(1, &sp->pibo);
-    if (sp->libo) glDeleteBuffers(1, &sp->libo);
-#endif
+    char   rec[MAXSTR + 64];
+    size_t n = strlen(dep);
+    char  *p;
 
-    sp->pibo = 0;
-    sp->libo = 0;
+    /* Append a file's record to a dependency list, dropping it on failure. */
 
-    /* Release this surface's polygon and line vectors. */
+    dep_rec(rec, path);
 
-    if (sp->pv) free(sp->pv);
-    if (sp->lv) free(sp->lv);
+    if ((p = (char *) realloc(dep, n + strlen(rec) + 1)))
+        strcpy(p + n, rec);
+    else
+        free(dep);
+
+    return p;
 }
 
-static void obj_rel(obj *O)
+static int load_named(struct obj_load *L, const char *name, char **p,
+                                               size_t *n, int *mapped)
 {
-    int si;
-    int mi;
+    char pathname[MAXSTR];
+    char *q;
 
-    /* Release resources held by this file and it's materials and surfaces. */
+    /* Ask the resolver for the named file, or read it from disk. If the */
+    /* caller accepts it, map the file when the read options ask.        */
 
-#ifndef CONF_NO_GL
-    if (O->vbo) glDeleteBuffers     (1, &O->vbo);
-    if (O->vao) glDeleteVertexArrays(1, &O->vao);
-#endif
+    if (mapped)
+        *mapped = 0;
 
-    O->vbo = 0;
+    if (L->res)
+    {
+        if ((*p = (char *) L->res(L->res_data, name, n)))
+        {
+            /* Null-terminate the resolved buffer. */
 
-    for (mi = 0; mi < O->mc; ++mi) obj_rel_mtrl(O->mv + mi);
-    for (si = 0; si < O->sc; ++si) obj_rel_surf(O->sv + si);
-}
+            if ((q = (char *) realloc(*p, *n + 1)))
+            {
+                *p       = q;
+                (*p)[*n] = '\0';
+                return 1;
+            }
+            free(*p);
+        }
+        return 0;
+    }
 
-/*============================================================================*/
+    /* Skip a file whose path name does not fit. */
 
-obj *obj_create(const char *filename)
+    if (snprintf(pathname, MAXSTR, "%s/%s", L->dir, name) >= MAXSTR)
+        return 0;
+
+    if (L->dep)
+        L->dep = add_dep(L->dep, pathname);
+
+#ifndef CONF_NO_MMAP
+    if (mapped && (L->O->ropt & OBJ_READ_MMAP))
+        return (*mapped = map_file(pathname, p, n));
+#endif
+    return load_file(pathname, p, n);
+}
+
+static void scan_map(const char *c, const char *e, char *map,
+                     unsigned int *clamp, float *o, float *s)
 {
-    obj *O;
-    int  i;
+    char val[MAXSTR];
 
-    /* Allocate and initialize a new file. */
+    const char *d;
+    const char *f;
 
-    if ((O = (obj *) calloc(1, sizeof (obj))))
-    {
-        if (filename)
-        {
-            /* Read the named file. */
+    size_t n;
+
+    memset(map, 0, MAXSTR);
 
-            read_obj(O, filename);
+    while ((c = skip_space(c, e)) < e)
+    {
+        d = skip_word(c, e);
 
-            /* Post-process the loaded object. */
+        /* Parse property map options. */
 
-            obj_mini(O);
-            obj_proc(O);
+        if (is_word(c, d, "-clamp") && scan_word(&d, e, val))
+        {
+            *clamp = (strcmp(val, "on") == 0) ? OBJ_OPT_CLAMP : 0;
+            c      = d;
         }
 
-        /* Set default shader locations. */
+        /* Parse property map scale and offset. */
 
-        for (i = 0; i < OBJ_PROP_COUNT; i++)
+        else if (is_word(c, d, "-s") && scan_floats(&d, e, s, 3)) c = d;
+        else if (is_word(c, d, "-o") && scan_floats(&d, e, o, 3)) c = d;
+
+        /* Check for a file name */
+
+        else if ((f = find_str(c, e, ".tga")) ||
+                 (f = find_str(c, e, ".TGA")))
         {
-            O->cloc[i] = -1;
-            O->oloc[i] = -1;
-            O->Mloc[i] = -1;
+            if ((n = (size_t) (f - c) + 4) > MAXSTR - 1)
+                n = MAXSTR - 1;
+
+            memcpy(map, c, n);
+            break;
         }
-        O->uloc = -1;
-        O->nloc = -1;
-        O->tloc = -1;
-        O->vloc = -1;
+
+        /* If we see something we don't recognize, stop looking. */
+
+        else break;
     }
-    return O;
 }
 
-void obj_delete(obj *O)
+static void read_image(struct obj_load *L, int mi, int ki, const char *c,
+                                                          const char *e)
 {
-    assert(O);
+    obj *O = L->O;
 
-    obj_rel(O);
-
-    free(O);
-}
+    unsigned int clamp  = 0;
 
-/*----------------------------------------------------------------------------*/
+    float o[3] = { 0.0f, 0.0f, 0.0f };
+    float s[3] = { 1.0f, 1.0f, 1.0f };
 
-int obj_add_mtrl(obj *O)
-{
-    unsigned int opt = 0;
+    char pathname[MAXSTR];
+    char map[MAXSTR];
 
-    const float Kd[4] = { 0.8f, 0.8f, 0.8f, 1.0f };
-    const float Ka[4] = { 0.2f, 0.2f, 0.2f, 1.0f };
-    const float Ke[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
-    const float Ks[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
-    const float Ns[4] = { 8.0f, 0.0f, 0.0f, 0.0f };
-    const float  s[3] = { 1.0f, 1.0f, 1.0f       };
+    size_t n;
 
-    int mi;
+    scan_map(c, e, map, &clamp, o, s);
 
-    assert(O);
+    /* Apply all parsed property attributes to the material. */
 
-    /* Allocate and initialize a new material. */
+    obj_set_mtrl_opt(O, mi, ki, clamp);
 
-    if ((mi = add__((void **) &O->mv,
-                              &O->mc,
-                              &O->mm, sizeof (struct obj_mtrl))) >= 0)
+    if (L->res)
     {
-        memset(O->mv + mi, 0, sizeof (struct obj_mtrl));
+        struct obj_image *I = NULL;
 
-        obj_set_mtrl_opt(O, mi, OBJ_KD, opt);
-        obj_set_mtrl_opt(O, mi, OBJ_KA, opt);
-        obj_set_mtrl_opt(O, mi, OBJ_KE, opt);
-        obj_set_mtrl_opt(O, mi, OBJ_KS, opt);
-        obj_set_mtrl_opt(O, mi, OBJ_NS, opt);
-        obj_set_mtrl_opt(O, mi, OBJ_KN, opt);
+        int   w;
+        int   h;
+        int   k;
+        char *p;
+        void *q;
 
-        obj_set_mtrl_c  (O, mi, OBJ_KD, Kd);
-        obj_set_mtrl_c  (O, mi, OBJ_KA, Ka);
-        obj_set_mtrl_c  (O, mi, OBJ_KE, Ke);
-        obj_set_mtrl_c  (O, mi, OBJ_KS, Ks);
-        obj_set_mtrl_c  (O, mi, OBJ_NS, Ns);
+        /* Decode a resolved image. Such images are not shared. */
 
-        obj_set_mtrl_s  (O, mi, OBJ_KD, s);
-        obj_set_mtrl_s  (O, mi, OBJ_KA, s);
-        obj_set_mtrl_s  (O, mi, OBJ_KE, s);
-        obj_set_mtrl_s  (O, mi, OBJ_KS, s);
-        obj_set_mtrl_s  (O, mi, OBJ_NS, s);
-        obj_set_mtrl_s  (O, mi, OBJ_KN, s);
+        if (map[0] && load_named(L, map, &p, &n, NULL))
+        {
+            if ((q = read_tga_buffer(p, n, &w, &h, &k)))
+            {
+                lock_images();
+                I = new_image(map, q, w, h, k);
+                unlock_images();
+            }
+            free(p);
+        }
+        set_map(O, mi, ki, map, I);
     }
-    return mi;
-}
-
-int obj_add_vert(obj *O)
-{
-    int vi;
+    else if (snprintf(pathname, MAXSTR, "%s/%s", L->dir, map) < MAXSTR)
+        set_map(O, mi, ki, pathname, get_image(pathname));
 
-    assert(O);
+    if (L->defer == 0)
+        bind_map(O, mi, ki);
 
-    /* Allocate and initialize a new vertex. */
+    obj_set_mtrl_o  (O, mi, ki, o);
+    obj_set_mtrl_s  (O, mi, ki, s);
+}
 
-    if ((vi = add__((void **) &O->vv,
-                              &O->vc,
-                              &O->vm, sizeof (struct obj_vert))) >= 0)
+static void read_color(obj *O, int mi, int ki, const char *c,
+                                               const char *e)
+{
+    float k[4];
 
-        memset(O->vv + vi, 0, sizeof (struct obj_vert));
+    /* Merge incoming color components with existing defaults. */
 
-    return vi;
+    obj_get_mtrl_c(O, mi, ki, k);
+    scan_floats(&c, e, k, 3);
+    obj_set_mtrl_c(O, mi, ki, k);
 }
 
-int obj_add_poly(obj *O, int si)
+static void read_alpha(obj *O, int mi, int ki, const char *c,
+                                               const char *e)
 {
-    int pi;
+    float k[4];
+    float t = 0.0f;
 
-    assert_surf(O, si);
+    /* Merge incoming color components with existing defaults. */
 
-    /* Allocate and initialize a new polygon. */
+    obj_get_mtrl_c(O, mi, ki, k);
+    scan_float(&c, e, &t);
+    k[3] = 1.0f - t;
+    obj_set_mtrl_c(O, mi, ki, k);
+}
 
-    if ((pi = add__((void **) &O->sv[si].pv,
-                              &O->sv[si].pc,
-                              &O->sv[si].pm, sizeof (struct obj_poly)))>=0)
+struct mtl_load
+{
+    struct obj_load *L;         /* Load receiving the material          */
+    obj             *O;         /* Object receiving the material        */
+    int              mi;        /* Index of the receiving material      */
+};
 
-        memset(O->sv[si].pv + pi, 0, sizeof (struct obj_poly));
+static int read_mtl_line(void *data, const char *c, const char *e)
+{
+    struct mtl_load *M = (struct mtl_load *) data;
+
+    const char *k = skip_space(c, e);
+    const char *d = skip_word (k, e);
+
+    obj *O  = M->O;
+    int  mi = M->mi;
+
+    /* Parse this material's properties. */
+
+    if      (is_word(k, d, "map_Kd"))
+        read_image(M->L, mi, OBJ_KD, d, e);
+    else if (is_word(k, d, "map_Ka"))
+        read_image(M->L, mi, OBJ_KA, d, e);
+    else if (is_word(k, d, "map_Ke"))
+        read_image(M->L, mi, OBJ_KE, d, e);
+    else if (is_word(k, d, "map_Ks"))
+        read_image(M->L, mi, OBJ_KS, d, e);
+    else if (is_word(k, d, "map_Ns"))
+        read_image(M->L, mi, OBJ_NS, d, e);
+    else if (is_word(k, d, "map_Kn"))
+        read_image(M->L, mi, OBJ_KN, d, e);
+
+    else if (is_word(k, d, "Kd"))
+        read_color(O, mi, OBJ_KD, d, e);
+    else if (is_word(k, d, "Ka"))
+        read_color(O, mi, OBJ_KA, d, e);
+    else if (is_word(k, d, "Ke"))
+        read_color(O, mi, OBJ_KE, d, e);
+    else if (is_word(k, d, "Ks"))
+        read_color(O, mi, OBJ_KS, d, e);
+    else if (is_word(k, d, "Ns"))
+        read_color(O, mi, OBJ_NS, d, e);
+
+    else if (is_word(k, d, "d"))
+        read_alpha(O, mi, OBJ_KD, d, e);
+    else if (is_word(k, d, "Tr"))
+        read_alpha(O, mi, OBJ_KD, d, e);
 
-    return pi;
+    return 0;
 }
 
-int obj_add_line(obj *O, int si)
+/*----------------------------------------------------------------------------*/
+
+static int *find_mtl_def(struct obj_load *L, const char *name, size_t n)
 {
-    int li;
+    int *t = L->_dt + (hash_name(name, n) & (L->_dh - 1));
 
-    assert_surf(O, si);
+    /* Probe for the named definition or the empty slot it belongs in. */
 
-    /* Allocate and initialize a new line. */
+    while (*t >= 0 && (L->_dv[*t].n != n || memcmp(L->_dv[*t].name, name, n)))
+        if (++t == L->_dt + L->_dh)
+            t = L->_dt;
 
-    if ((li = add__((void **) &O->sv[si].lv,
-                              &O->sv[si].lc,
-                              &O->sv[si].lm, sizeof (struct obj_line)))>=0)
+    return t;
+}
 
-        memset(O->sv[si].lv + li, 0, sizeof (struct obj_line));
+static void put_mtl_def(struct obj_load *L, int di)
+{
+    int *t = find_mtl_def(L, L->_dv[di].name, L->_dv[di].n);
 
-    return li;
+    /* A later library overrides, but a library's first definition stands. */
+
+    if (*t < 0 || L->_dv[*t].li != L->_dv[di].li)
+        *t = di;
 }
 
-int obj_add_surf(obj *O)
+static int grow_mtl_def(struct obj_load *L)
 {
-    int si;
+    int  m = (L->_dh > 0) ? L->_dh * 2 : 64;
+    int *t;
+    int  i;
 
-    assert(O);
+    /* Allocate a larger table and reinsert all definitions in order. */
 
-    /* Allocate and initialize a new surface. */
-
-    if ((si = add__((void **) &O->sv,
-                              &O->sc,
-                              &O->sm, sizeof (struct obj_surf))) >= 0)
-
-        memset(O->sv + si, 0, sizeof (struct obj_surf));
-
-    return si;
-}
-
-/*----------------------------------------------------------------------------*/
+    if ((t = (int *) malloc(m * sizeof (int))))
+    {
+        for (i = 0; i < m; ++i)
+            t[i] = -1;
 
-int obj_num_mtrl(const obj *O)
-{
-    assert(O);
-    return O->mc;
-}
+        free(L->_dt);
 
-int obj_num_vert(const obj *O)
-{
-    assert(O);
-    return O->vc;
-}
+        L->_dt = t;
+        L->_dh = m;
 
-int obj_num_poly(const obj *O, int si)
-{
-    assert_surf(O, si);
-    return O->sv[si].pc;
-}
+        for (i = 0; i < L->_dc - 1; ++i)
+            put_mtl_def(L, i);
 
-int obj_num_line(const obj *O, int si)
-{
-    assert_surf(O, si);
-    return O->sv[si].lc;
+        return 1;
+    }
+    return 0;
 }
 
-int obj_num_surf(const obj *O)
+static void index_mtl(struct obj_load *L, int li, const char *c,
+                                                  const char *e)
 {
-    assert(O);
-    return O->sc;
-}
-
+    const char *d;
+    const char *k;
+    const char *w;
 
-/*----------------------------------------------------------------------------*/
+    int di = -1;
 
-void obj_del_mtrl(obj *O, int mi)
-{
-    int si;
+    /* Find each newmtl line, noting the name and the lines following. */
 
-    assert_mtrl(O, mi);
+    while (c < e)
+    {
+        if ((d = (const char *) memchr(c, '\n', e - c)) == NULL)
+            d = e;
 
-    /* Remove this material from the material vector. */
+        k = skip_space(c, d);
+        w = skip_word (k, d);
 
-    obj_rel_mtrl(O->mv + mi);
+        if (is_word(k, w, "newmtl"))
+        {
+            if (di >= 0)
+                L->_dv[di].e = c;
 
-    memmove(O->mv + mi,
-            O->mv + mi + 1,
-           (O->mc - mi - 1) * sizeof (struct obj_mtrl));
+            if ((di = add_d(L)) >= 0)
+            {
+                k = skip_space(w, d);
+                w = skip_word (k, d);
 
-    O->mc--;
+                L->_dv[di].name = k;
+                L->_dv[di].n    = (size_t) (w - k);
+                L->_dv[di].c    = (d < e) ? d + 1 : e;
+                L->_dv[di].e    = e;
+                L->_dv[di].li   = li;
 
-    /* Remove all references to this material. */
+                if (L->_dv[di].n > MAXSTR - 1)
+                    L->_dv[di].n = MAXSTR - 1;
 
-    for (si = O->sc - 1; si >= 0; --si)
-    {
-        struct obj_surf *sp = O->sv + si;
+                /* Add it to the name table, growing the table as needed. */
 
-        if (sp->mi == mi)
-            obj_del_surf(O, si);
-        else
-            if (sp->mi > mi)
-                sp->mi--;
+                if (2 * L->_dc > L->_dh && !grow_mtl_def(L))
+                {
+                    L->_dc--;
+                    di = -1;
+                }
+                else put_mtl_def(L, di);
+            }
+        }
+        c = (d < e) ? d + 1 : e;
     }
 }
 
-void obj_del_vert(obj *O, int vi)
+static void read_mtl(struct obj_load *L, const char *name, int mi)
 {
-    int si;
-    int pi;
-    int li;
+    struct mtl_load M;
 
-    assert_vert(O, vi);
+    const char *c;
+    int        *t;
 
-    /* Remove this vertex from the file's vertex vector. */
+    /* Look up the named material and apply its properties. */
 
-    memmove(O->vv + vi,
-            O->vv + vi + 1,
-           (O->vc - vi - 1) * sizeof (struct obj_vert));
+    if (L->_dh > 0 && *(t = find_mtl_def(L, name, strlen(name))) >= 0)
+    {
+        const struct mtl_def *D = L->_dv + *t;
 
-    O->vc--;
+        M.L  = L;
+        M.O  = L->O;
+        M.mi = mi;
 
-    /* Remove all references to this vertex from all surfaces. */
+        obj_set_mtrl_name(L->O, mi, name);
 
-    for (si = 0; si < O->sc; ++si)
-    {
-        /* Delete all referencing polygons. Decrement later references. */
+        /* A mapped library has no terminator, so copy any unterminated */
+        /* final line as a mapped OBJ file does.                        */
 
-        for (pi = O->sv[si].pc - 1; pi >= 0; --pi)
-        {
-            struct obj_poly *pp = O->sv[si].pv + pi;
+        if ((c = read_lines(read_mtl_line, &M, D->c, D->e)))
+            read_last(read_mtl_line, &M, c, D->e);
+    }
+}
 
-            if (pp->vi[0] == vi || pp->vi[1] == vi || pp->vi[2] == vi)
-                obj_del_poly(O, si, pi);
-            else
-            {
-                if (pp->vi[0] > vi) pp->vi[0]--;
-                if (pp->vi[1] > vi) pp->vi[1]--;
-                if (pp->vi[2] > vi) pp->vi[2]--;
-            }
-        }
+static void read_mtllib(struct obj_load *L, const char *c, const char *e)
+{
+    char file[MAXSTR];
 
-        /* Delete all referencing lines. Decrement later references. */
+    struct mtl_lib B;
+    int            li;
 
-        for (li = O->sv[si].lc - 1; li >= 0; --li)
-        {
-            struct obj_line *lp = O->sv[si].lv + li;
+    /* Load and index each named library, keeping it for the load's life. */
 
-            if (lp->vi[0] == vi || lp->vi[1] == vi)
-                obj_del_line(O, si, li);
-            else
+    while (scan_word(&c, e, file))
+    {
+        if (load_named(L, file, &B.p, &B.n, &B.mapped))
+        {
+            if ((li = add_l(L)) >= 0)
             {
-                if (lp->vi[0] > vi) lp->vi[0]--;
-                if (lp->vi[1] > vi) lp->vi[1]--;
+                L->_lv[li] = B;
+                index_mtl(L, li, B.p, B.p + B.n);
             }
+            else free_lib(&B);
         }
     }
-
-    /* Schedule the VBO for refresh. */
-
-    invalidate(O);
 }
 
-void obj_del_poly(obj *O, int si, int pi)
+static struct mtl_use *find_mtl_use(struct obj_load *L, const char *name)
 {
-    assert_poly(O, si, pi);
+    struct mtl_use *u = L->_uv + (hash_name(name,
+                                  strlen(name)) & (L->_uh - 1));
 
-    /* Remove this polygon from the surface's polygon vector. */
+    /* Probe for the named use or the empty slot it belongs in. */
 
-    memmove(O->sv[si].pv + pi,
-            O->sv[si].pv + pi + 1,
-           (O->sv[si].pc - pi - 1) * sizeof (struct obj_poly));
+    while (u->name && strcmp(u->name, name))
+        if (++u == L->_uv + L->_uh)
+            u = L->_uv;
 
-    O->sv[si].pc--;
+    return u;
 }
 
-void obj_del_line(obj *O, int si, int li)
+static int grow_mtl_use(struct obj_load *L)
 {
-    assert_line(O, si, li);
-
-    /* Remove this line from the surface's line vector. */
+    int m = (L->_uh > 0) ? L->_uh * 2 : 64;
+    int i;
 
-    memmove(O->sv[si].lv + li,
-            O->sv[si].lv + li + 1,
-           (O->sv[si].lc - li - 1) * sizeof (struct obj_line));
+    struct mtl_use *v = L->_uv;
+    struct mtl_use *u;
 
-    O->sv[si].lc--;
-}
+    /* Allocate a larger table and rehash all uses. */
 
-void obj_del_surf(obj *O, int si)
-{
-    assert_surf(O, si);
+    if ((L->_uv = (struct mtl_use *) calloc(m, sizeof (struct mtl_use))))
+    {
+        for (i = 0; i < L->_uh; ++i)
+            if (v[i].name)
+            {
+                u = L->_uv + (hash_name(v[i].name,
+                                 strlen(v[i].name)) & (m - 1));
 
-    /* Remove this surface from the file's surface vector. */
+                while (u->name)
+                    if (++u == L->_uv + m)
+                        u = L->_uv;
 
-    obj_rel_surf(O->sv + si);
+                *u = v[i];
+            }
 
-    memmove(O->sv + si,
-            O->sv + si + 1,
-           (O->sc - si - 1) * sizeof (struct obj_surf));
+        free(v);
 
-    O->sc--;
+        L->_uh = m;
+        return 1;
+    }
+    L->_uv = v;
+    return 0;
 }
 
-/*----------------------------------------------------------------------------*/
-
-static char *set_name(char *old, const char *src)
+static struct mtl_use *get_mtl_use(struct obj_load *L, const char *name)
 {
-    char *dst = NULL;
+    struct mtl_use *u;
 
-    if (old)
-        free(old);
+    /* Find the named use, adding it if it is new. */
 
-    if (src && (dst = (char *) malloc(strlen(src) + 1)))
-        strcpy(dst, src);
+    if (2 * (L->_uc + 1) <= L->_uh || grow_mtl_use(L))
+    {
+        u = find_mtl_use(L, name);
 
-    return dst;
+        if (u->name == NULL && (u->name = (char *) malloc(strlen(name) + 1)))
+        {
+            strcpy(u->name, name);
+            u->si = -1;
+            L->_uc++;
+        }
+        if (u->name)
+            return u;
+    }
+    return NULL;
 }
 
-void obj_set_mtrl_name(obj *O, int mi, const char *name)
+static void reserve_surf(obj *O, int si, int pc, int lc)
 {
-    assert_mtrl(O, mi);
-    O->mv[mi].name = set_name(O->mv[mi].name, name);
+    struct obj_surf *sp = O->sv + si;
+
+    /* Size the surface's polygon and line vectors for prescanned counts. */
+
+    reserve__((void **) &sp->pv, &sp->pm, sizeof (struct obj_poly),
+              sp->pc + pc);
+    reserve__((void **) &sp->lv, &sp->lm, sizeof (struct obj_line),
+              sp->lc + lc);
 }
 
-void obj_set_mtrl_map(obj *O, int mi, int ki, const char *str)
+static void read_usemtl(struct obj_load *L, const char *c, const char *e)
 {
-    assert_prop(O, mi, ki);
+    struct mtl_use *u;
 
-#ifndef CONF_NO_GL
-    if (O->mv[mi].kv[ki].map)
-        glDeleteTextures(1, &O->mv[mi].kv[ki].map);
-#endif
+    char name[MAXSTR];
 
-    O->mv[mi].kv[ki].map = obj_load_image(str);
-    O->mv[mi].kv[ki].str = set_name(O->mv[mi].kv[ki].str, str);
-}
+    int si;
+    int mi;
 
-void obj_set_mtrl_opt(obj *O, int mi, int ki, unsigned int opt)
-{
-    assert_prop(O, mi, ki);
+    scan_word(&c, e, name);
 
-    O->mv[mi].kv[ki].opt = opt;
-}
+    /* If this material has been used before, continue its surface. */
 
-void obj_set_mtrl_c(obj *O, int mi, int ki, const float c[4])
-{
-    assert_prop(O, mi, ki);
+    if ((u = get_mtl_use(L, name)) && u->si >= 0)
+    {
+        L->si = u->si;
+        return;
+    }
 
-    O->mv[mi].kv[ki].c[0] = c[0];
-    O->mv[mi].kv[ki].c[1] = c[1];
-    O->mv[mi].kv[ki].c[2] = c[2];
-    O->mv[mi].kv[ki].c[3] = c[3];
-}
+    /* Create a new material for the incoming definition. */
 
-void obj_set_mtrl_s(obj *O, int mi, int ki, const float s[3])
-{
-    assert_prop(O, mi, ki);
+    if ((mi = obj_add_mtrl(L->O)) >= 0)
+    {
+        /* Create a new surface to contain geometry with the new material. */
 
-    O->mv[mi].kv[ki].s[0] = s[0];
-    O->mv[mi].kv[ki].s[1] = s[1];
-    O->mv[mi].kv[ki].s[2] = s[2];
-}
+        if ((si = obj_add_surf(L->O)) >= 0)
+        {
+            /* Read the material definition and apply it to the new surface. */
 
-void obj_set_mtrl_o(obj *O, int mi, int ki, const float o[3])
-{
-    assert_prop(O, mi, ki);
+            read_mtl(L, name, mi);
+            obj_set_surf(L->O, si, mi);
 
-    O->mv[mi].kv[ki].o[0] = o[0];
-    O->mv[mi].kv[ki].o[1] = o[1];
-    O->mv[mi].kv[ki].o[2] = o[2];
+            /* Note the surface for reuse by later uses of this material. */
+
+            if (u)
+            {
+                u->si = si;
+                reserve_surf(L->O, si, u->pc, u->lc);
+            }
+
+            /* New geometry will be added to this surface. */
+
+            L->si = si;
+            return;
+        }
+    }
+
+    /* On failure, revert to the default surface. */
+
+    L->si = 0;
 }
 
 /*----------------------------------------------------------------------------*/
 
-static void invalidate(obj *O)
+static const char *read_poly_indices(const char *c, const char *e,
+                                     int *_vi, int *_ti, int *_ni)
 {
-#ifndef CONF_NO_GL
-    if (O->vbo) glDeleteBuffers     (1, &O->vbo);
-    if (O->vao) glDeleteVertexArrays(1, &O->vao);
-#endif
-    O->vbo = 0;
-    O->vao = 0;
-}
+    const char *d;
 
-void obj_set_vert_v(obj *O, int vi, const float v[3])
-{
-    assert_vert(O, vi);
+    *_vi = 0;
+    *_ti = 0;
+    *_ni = 0;
 
-    O->vv[vi].v[0] = v[0];
-    O->vv[vi].v[1] = v[1];
-    O->vv[vi].v[2] = v[2];
+    /* Parse a face vertex specification of the form v, v/t, v//n, or v/t/n. */
 
-    invalidate(O);
-}
+    if (!scan_int(&c, e, _vi))
+        return NULL;
 
-void obj_set_vert_t(obj *O, int vi, const float t[2])
-{
-    assert_vert(O, vi);
+    if (c < e && c[0] == '/')
+    {
+        d = c + 1;
 
-    O->vv[vi].t[0] = t[0];
-    O->vv[vi].t[1] = t[1];
+        if (d < e && d[0] == '/')
+        {
+            d++;
+            if (scan_int(&d, e, _ni)) return d;
+        }
+        else if (scan_int(&d, e, _ti))
+        {
+            c = d;
 
-    invalidate(O);
+            if (d < e && d[0] == '/')
+            {
+                d++;
+                if (scan_int(&d, e, _ni)) return d;
+            }
+        }
+    }
+    return c;
 }
 
-void obj_set_vert_n(obj *O, int vi, const float n[3])
+static struct iset *find_vert_iset(struct obj_load *L, int _vi, int _ti,
+                                                       int _ni, int  gi)
 {
-    assert_vert(O, vi);
+    int _si;
+    int  n = 0;
 
-    O->vv[vi].n[0] = n[0];
-    O->vv[vi].n[1] = n[1];
-    O->vv[vi].n[2] = n[2];
+    if (0 <= _vi && _vi < L->_vc)
+    {
+        /* Search the sets listed at this position. */
 
-    invalidate(O);
-}
+        for (_si = L->_vv[_vi]._ii; _si >= 0; _si = L->_sv[_si]._ii, ++n)
+            if (L->_sv[_si]._ti == _ti &&
+                L->_sv[_si]._ni == _ni &&
+                L->_sv[_si]. gi ==  gi)
+                return L->_sv + _si;
 
-void obj_set_vert_u(obj *O, int vi, const float u[3])
-{
-    assert_vert(O, vi);
+        /* If the list is not full, add a new set to its head. */
 
-    O->vv[vi].u[0] = u[0];
-    O->vv[vi].u[1] = u[1];
-    O->vv[vi].u[2] = u[2];
+        if (n < MAXSET && (_si = add_s(L)) >= 0)
+        {
+            L->_sv[_si]._vi = _vi;
+            L->_sv[_si]._ti = _ti;
+            L->_sv[_si]._ni = _ni;
+            L->_sv[_si]. gi =  gi;
+            L->_sv[_si]. vi =  -1;
+            L->_sv[_si]._ii = L->_vv[_vi]._ii;
 
-    invalidate(O);
-}
+            L->_vv[_vi]._ii = _si;
 
-/*----------------------------------------------------------------------------*/
+            return L->_sv + _si;
+        }
+    }
 
-void obj_set_poly(obj *O, int si, int pi, const int vi[3])
-{
-    assert_poly(O, si, pi);
+    /* Otherwise, defer to the hash table. */
 
-    O->sv[si].pv[pi].vi[0] = (index_t) vi[0];
-    O->sv[si].pv[pi].vi[1] = (index_t) vi[1];
-    O->sv[si].pv[pi].vi[2] = (index_t) vi[2];
+    return find_iset(L, _vi, _ti, _ni, gi);
 }
 
-void obj_set_line(obj *O, int si, int li, const int vi[2])
+static int read_vertex(struct obj_load *L, int _vi, int _ti,
+                                          int _ni, int  gi)
 {
-    assert_line(O, si, li);
+    obj *O = L->O;
 
-    O->sv[si].lv[li].vi[0] = (index_t) vi[0];
-    O->sv[si].lv[li].vi[1] = (index_t) vi[1];
-}
+    struct iset *S;
 
-void obj_set_surf(obj *O, int si, int mi)
-{
-    assert_surf(O, si);
+    int _ii;
+    int  vi;
 
-    O->sv[si].mi = mi;
-}
+    /* Find the index set, adding a new vertex if it is not yet known. */
 
-/*----------------------------------------------------------------------------*/
+    if ((S = find_vert_iset(L, _vi, _ti, _ni, gi)) == NULL)
+        return -1;
 
-void obj_set_vert_loc(obj *O, int u, int n, int t, int v)
-{
-    assert(O);
+    if (S->vi < 0)
+    {
+        /* Grow prescanned vertex storage no further than the corners. */
 
-    O->uloc = u;
-    O->nloc = n;
-    O->tloc = t;
-    O->vloc = v;
+        if (O->vc == O->vm && O->vm < L->vx)
+            reserve_vert(O, (O->vm < L->vx / 2) ? O->vm * 2 : L->vx);
 
-    invalidate(O);
-}
+        if ((vi = obj_add_vert(O)) < 0)
+            return -1;
 
-void obj_set_prop_loc(obj *O, int ki, int c, int o, int M)
-{
-    assert(O);
-    assert(0 <= ki && ki < OBJ_PROP_COUNT);
+        S->_vi = _vi;
+        S->_ti = _ti;
+        S->_ni = _ni;
+        S-> gi =  gi;
+        S-> vi =  vi;
 
-    O->cloc[ki] = c;
-    O->oloc[ki] = o;
-    O->Mloc[ki] = M;
-}
+        /* Initialize the new vertex using valid cache references. */
 
-/*============================================================================*/
+        if (0 <= _vi && _vi < L->_vc) obj_set_vert_v(O, vi, L->_vv[_vi].v);
+        if (0 <= _ni && _ni < L->_nc) obj_set_vert_n(O, vi, L->_nv[_ni].v);
+        if (0 <= _ti && _ti < L->_tc) obj_set_vert_t(O, vi, L->_tv[_ti].v);
+    }
 
-const char *obj_get_mtrl_name(const obj *O, int mi)
-{
-    assert_mtrl(O, mi);
-    return O->mv[mi].name;
-}
+    /* Record this corner of the current face or line. */
 
-unsigned int obj_get_mtrl_map(const obj *O, int mi, int ki)
-{
-    assert_prop(O, mi, ki);
-    return O->mv[mi].kv[ki].map;
+    if ((_ii = add_i(L)) >= 0)
+    {
+        L->_iv[_ii]._vi = _vi;
+        L->_iv[_ii]._ni = _ni;
+        L->_iv[_ii]. vi = S->vi;
+    }
+    return _ii;
 }
 
-unsigned int obj_get_mtrl_opt(const obj *O, int mi, int ki)
+static int read_poly_vertex(struct obj_load *L, int _vi, int _ti, int _ni)
 {
-    assert_prop(O, mi, ki);
-    return O->mv[mi].kv[ki].opt;
-}
+    /* Convert face indices to vector cache indices. */
 
-void obj_get_mtrl_c(const obj *O, int mi, int ki, float *c)
-{
-    assert_prop(O, mi, ki);
+    _vi += (_vi < 0) ? L->_vc : -1;
+    _ti += (_ti < 0) ? L->_tc : -1;
+    _ni += (_ni < 0) ? L->_nc : -1;
 
-    c[0] = O->mv[mi].kv[ki].c[0];
-    c[1] = O->mv[mi].kv[ki].c[1];
-    c[2] = O->mv[mi].kv[ki].c[2];
-    c[3] = O->mv[mi].kv[ki].c[3];
+    return read_vertex(L, _vi, _ti, _ni, L->gi);
 }
 
-void obj_get_mtrl_s(const obj *O, int mi, int ki, float *s)
+static void read_poly(struct obj_load *L, int ic)
 {
-    assert_prop(O, mi, ki);
+    obj *O = L->O;
 
-    s[0] = O->mv[mi].kv[ki].s[0];
-    s[1] = O->mv[mi].kv[ki].s[1];
-    s[2] = O->mv[mi].kv[ki].s[2];
-}
+    float n[3];
+    float t[3];
+    int i, pi;
 
-void obj_get_mtrl_o(const obj *O, int mi, int ki, float *o)
-{
-    assert_prop(O, mi, ki);
+    /* If smoothing, apply this face's normal to vertices that need it. */
 
-    o[0] = O->mv[mi].kv[ki].o[0];
-    o[1] = O->mv[mi].kv[ki].o[1];
-    o[2] = O->mv[mi].kv[ki].o[2];
-}
+    if (L->gi)
+    {
+        normal(n, L->_vv[L->_iv[0]._vi].v,
+                  L->_vv[L->_iv[1]._vi].v,
+                  L->_vv[L->_iv[2]._vi].v);
 
-/*----------------------------------------------------------------------------*/
+        for (i = 0; i < ic; ++i)
+            if (L->_iv[0]._ni < 0)
+            {
+                obj_get_vert_n(O, L->_iv[i]._vi, t);
+                t[0] += n[0];
+                t[1] += n[1];
+                t[2] += n[2];
+                obj_set_vert_n(O, L->_iv[i]._vi, t);
+            }
+    }
 
-void obj_get_vert_v(const obj *O, int vi, float *v)
-{
-    assert_vert(O, vi);
+    /* Convert our N new vertex references into N-2 new triangles. */
 
-    v[0] = O->vv[vi].v[0];
-    v[1] = O->vv[vi].v[1];
-    v[2] = O->vv[vi].v[2];
-}
+    for (i = 0; i < ic - 2; ++i)
 
-void obj_get_vert_t(const obj *O, int vi, float *t)
-{
-    assert_vert(O, vi);
+        if ((pi = obj_add_poly(O, L->si)) >= 0)
+        {
+            int vi[3];
 
-    t[0] = O->vv[vi].t[0];
-    t[1] = O->vv[vi].t[1];
+            vi[0] = L->_iv[0    ].vi;
+            vi[1] = L->_iv[i + 1].vi;
+            vi[2] = L->_iv[i + 2].vi;
+
+            obj_set_poly(O, L->si, pi, vi);
+        }
 }
 
-void obj_get_vert_n(const obj *O, int vi, float *n)
+static void read_f(struct obj_load *L, const char *c, const char *e)
 {
-    assert_vert(O, vi);
+    const char *d;
 
-    n[0] = O->vv[vi].n[0];
-    n[1] = O->vv[vi].n[1];
-    n[2] = O->vv[vi].n[2];
-}
+    int _vi;
+    int _ti;
+    int _ni;
 
-/*----------------------------------------------------------------------------*/
+    int ic = 0;
 
-void obj_get_poly(const obj *O, int si, int pi, int *vi)
-{
-    assert_poly(O, si, pi);
+    if (L->sel == 0)
+        return;
 
-    vi[0] = (int) O->sv[si].pv[pi].vi[0];
-    vi[1] = (int) O->sv[si].pv[pi].vi[1];
-    vi[2] = (int) O->sv[si].pv[pi].vi[2];
-}
+    /* Scan the face string, converting index sets to vertices. */
 
-void obj_get_line(const obj *O, int si, int li, int *vi)
-{
-    assert_line(O, si, li);
+    L->_ic = 0;
 
-    vi[0] = (int) O->sv[si].lv[li].vi[0];
-    vi[1] = (int) O->sv[si].lv[li].vi[1];
-}
+    while ((d = read_poly_indices(c, e, &_vi, &_ti, &_ni)))
+    {
+        if (read_poly_vertex(L, _vi, _ti, _ni) >= 0)
+            ic++;
+        c = d;
+    }
 
-int obj_get_surf(const obj *O, int si)
-{
-    assert_surf(O, si);
-    return O->sv[si].mi;
+    /* Convert these vertices to triangles. */
+
+    read_poly(L, ic);
 }
 
-/*============================================================================*/
+/*----------------------------------------------------------------------------*/
 
-void obj_mini(obj *O)
+static const char *read_line_indices(const char *c, const char *e,
+                                     int *_vi, int *_ti)
 {
-    int si;
-    int mi;
+    const char *d;
 
-    /* Remove empty surfaces. */
+    *_vi = 0;
+    *_ti = 0;
 
-    for (si = O->sc - 1; si >= 0; --si)
-        if (O->sv[si].pc == 0 &&
-            O->sv[si].lc == 0)
-            obj_del_surf(O, si);
+    /* Parse a line vertex specification of the form v or v/t. */
 
-    /* Remove unreferenced materials. */
+    if (!scan_int(&c, e, _vi))
+        return NULL;
 
-    for (mi = O->mc - 1; mi >= 0; --mi)
+    if (c < e && c[0] == '/')
     {
-        int cc = 0;
-
-        for (si = 0; si < O->sc; ++si)
-            if (O->sv[si].mi == mi)
-                cc++;
-
-        if (cc == 0)
-            obj_del_mtrl(O, mi);
+        d = c + 1;
+        if (scan_int(&d, e, _ti)) return d;
     }
+    return c;
 }
 
-void obj_norm(obj *O)
+static int read_line_vertices(struct obj_load *L, const char *c,
+                                                  const char *e)
 {
-    int vi;
-    int si;
-    int pi;
+    const char *d;
 
-    assert(O);
+    int _vi;
+    int _ti;
+    int  ic = 0;
 
-    /* Zero the normals for all vertices. */
+    /* Scan the line string, converting index sets to vertices. */
 
-    for (vi = 0; vi < O->vc; ++vi)
+    L->_ic = 0;
+
+    while ((d = read_line_indices(c, e, &_vi, &_ti)))
     {
-        O->vv[vi].n[0] = 0;
-        O->vv[vi].n[1] = 0;
-        O->vv[vi].n[2] = 0;
+        /* Convert line indices to vector cache indices. */
+
+        _vi += (_vi < 0) ? L->_vc : -1;
+        _ti += (_ti < 0) ? L->_tc : -1;
+
+        if (read_vertex(L, _vi, _ti, -1, 0) >= 0)
+            ic++;
+
+        c = d;
     }
+    return ic;
+}
 
-    /* Compute normals for all faces. */
+static void read_l(struct obj_load *L, const char *c, const char *e)
+{
+    int i, li, ic;
 
-    for (si = 0; si < O->sc; ++si)
-        for (pi = 0; pi < O->sv[si].pc; ++pi)
-        {
-            struct obj_vert *v0 = O->vv + O->sv[si].pv[pi].vi[0];
-            struct obj_vert *v1 = O->vv + O->sv[si].pv[pi].vi[1];
-            struct obj_vert *v2 = O->vv + O->sv[si].pv[pi].vi[2];
+    if (L->sel == 0)
+        return;
 
-            float n[3];
+    /* Create new vertices for this line. */
 
-            /* Compute the normal formed by these 3 vertices. */
+    ic = read_line_vertices(L, c, e);
 
-            normal(n, v0->v, v1->v, v2->v);
+    /* Convert our N new vertices into N-1 new lines. */
 
-            /* Sum this normal to all vertices. */
+    for (i = 0; i < ic - 1; ++i)
 
-            v0->n[0] += n[0];
-            v0->n[1] += n[1];
-            v0->n[2] += n[2];
+        if ((li = obj_add_line(L->O, L->si)) >= 0)
+        {
+            int vi[2];
 
-            v1->n[0] += n[0];
-            v1->n[1] += n[1];
-            v1->n[2] += n[2];
+            vi[0] = L->_iv[i    ].vi;
+            vi[1] = L->_iv[i + 1].vi;
 
-            v2->n[0] += n[0];
-            v2->n[1] += n[1];
-            v2->n[2] += n[2];
+            obj_set_line(L->O, L->si, li, vi);
         }
 }
 
-void obj_proc(obj *O)
-{
-    int si;
-    int sj;
-    int pi;
-    int vi;
+/*----------------------------------------------------------------------------*/
 
-    assert(O);
+static void read_v(struct obj_load *L, const char *c, const char *e)
+{
+    int _vi;
 
-    /* Normalize all normals. Zero all tangent vectors. */
+    /* Parse a vertex position. */
 
-    for (vi = 0; vi < O->vc; ++vi)
+    if ((_vi = add_v(L)) >= 0)
     {
-        normalize(O->vv[vi].n);
+        memset(L->_vv + _vi, 0, sizeof (struct vec3));
 
-        O->vv[vi].u[0] = 0.0f;
-        O->vv[vi].u[1] = 0.0f;
-        O->vv[vi].u[2] = 0.0f;
+        scan_floats(&c, e, L->_vv[_vi].v, 3);
+        L->_vv[_vi]._ii = -1;
     }
+}
 
-    /* Compute tangent vectors for all vertices. */
-
-    for (si = 0; si < O->sc; ++si)
-        for (pi = 0; pi < O->sv[si].pc; ++pi)
-        {
-            struct obj_vert *v0 = O->vv + O->sv[si].pv[pi].vi[0];
-            struct obj_vert *v1 = O->vv + O->sv[si].pv[pi].vi[1];
-            struct obj_vert *v2 = O->vv + O->sv[si].pv[pi].vi[2];
+static void read_vt(struct obj_load *L, const char *c, const char *e)
+{
+    int _ti;
 
-            float dt1, dv1[3];
-            float dt2, dv2[3];
+    /* Parse a texture coordinate. */
 
-            float u[3];
+    if ((_ti = add_t(L)) >= 0)
+    {
+        memset(L->_tv + _ti, 0, sizeof (struct vec2));
 
-            /* Compute the tangent vector for this polygon. */
+        scan_floats(&c, e, L->_tv[_ti].v, 2);
+    }
+}
 
-            dv1[0] = v1->v[0] - v0->v[0];
-            dv1[1] = v1->v[1] - v0->v[1];
-            dv1[2] = v1->v[2] - v0->v[2];
+static void read_vn(struct obj_load *L, const char *c, const char *e)
+{
+    int _ni;
 
-            dv2[0] = v2->v[0] - v0->v[0];
-            dv2[1] = v2->v[1] - v0->v[1];
-            dv2[2] = v2->v[2] - v0->v[2];
+    /* Parse a normal. */
 
-            dt1    = v1->t[1] - v0->t[1];
-            dt2    = v2->t[1] - v0->t[1];
+    if ((_ni = add_n(L)) >= 0)
+    {
+        memset(L->_nv + _ni, 0, sizeof (struct vec3));
 
-            u[0]   = dt2 * dv1[0] - dt1 * dv2[0];
-            u[1]   = dt2 * dv1[1] - dt1 * dv2[1];
-            u[2]   = dt2 * dv1[2] - dt1 * dv2[2];
+        scan_floats(&c, e, L->_nv[_ni].v, 3);
+    }
+}
 
-            normalize(u);
+/*----------------------------------------------------------------------------*/
 
-            /* Accumulate the tangent vectors for this polygon's vertices. */
+static void read_o(struct obj_load *L, const char *c, const char *e)
+{
+    obj *O = L->O;
 
-            v0->u[0] += u[0];  v0->u[1] += u[1];  v0->u[2] += u[2];
-            v1->u[0] += u[0];  v1->u[1] += u[1];  v1->u[2] += u[2];
-            v2->u[0] += u[0];  v2->u[1] += u[1];  v2->u[2] += u[2];
-        }
+    char name[MAXSTR];
 
-    /* Orthonormalize each tangent basis. */
+    /* Select the faces of a named object. */
 
-    for (vi = 0; vi < O->vc; ++vi)
+    if (O->sfn)
     {
-        float *n = O->vv[vi].n;
-        float *u = O->vv[vi].u;
-
-        float v[3];
+        if (scan_word(&c, e, name) == 0)
+            name[0] = '\0';
 
-        cross(v, n, u);
-        cross(u, v, n);
-        normalize(u);
+        L->os  = O->sfn(O->sdata, OBJ_NAME_OBJECT, name);
+        L->sel = L->os || L->gs;
     }
+}
 
-    /* Sort surfaces such that transparent ones appear later. */
+static void read_g(struct obj_load *L, const char *c, const char *e)
+{
+    obj *O = L->O;
 
-    for (si = 0; si < O->sc; ++si)
-        for (sj = si + 1; sj < O->sc; ++sj)
-            if (O->mv[O->sv[si].mi].kv[OBJ_KD].c[3] <
-                O->mv[O->sv[sj].mi].kv[OBJ_KD].c[3])
-            {
-                struct obj_surf temp;
+    char name[MAXSTR];
 
-                temp      = O->sv[si];
-                O->sv[si] = O->sv[sj];
-                O->sv[sj] = temp;
-            }
-}
+    int n = 0;
 
-void obj_init(obj *O)
-{
-#ifndef CONF_NO_GL
-    if (O->vao == 0)
+    /* Select the faces of a group if any one of its names is selected. */
+
+    if (O->sfn)
     {
-        const size_t vs = sizeof (struct obj_vert);
-        const size_t ps = sizeof (struct obj_poly);
-        const size_t ls = sizeof (struct obj_line);
+        L->gs = 0;
 
-        int si;
+        for (; scan_word(&c, e, name); n++)
+            if (L->gs == 0 && O->sfn(O->sdata, OBJ_NAME_GROUP, name))
+                L->gs = 1;
 
-        /* Store the following bindings in a vertex array object. */
+        if (n == 0)
+            L->gs = O->sfn(O->sdata, OBJ_NAME_GROUP, "default");
 
-        glGenVertexArrays(1, &O->vao);
-        glBindVertexArray(    O->vao);
+        L->sel = L->os || L->gs;
+    }
+}
 
-        /* Store all vertex data in a vertex buffer object. */
+static int read_line(void *data, const char *c, const char *e)
+{
+    struct obj_load *L = (struct obj_load *) data;
 
-        glGenBuffers(1, &O->vbo);
-        glBindBuffer(GL_ARRAY_BUFFER, O->vbo);
-        glBufferData(GL_ARRAY_BUFFER, O->vc * vs, O->vv, GL_STATIC_DRAW);
+    const char *k = skip_space(c, e);
 
-        /* Store all index data in index buffer objects. */
+    /* Isolate the keyword and dispatch on its length and leading bytes. */
 
-        for (si = 0; si < O->sc; ++si)
+    switch ((c = skip_word(k, e)) - k)
+    {
+    case 1:
+        if      (k[0] == 'f') read_f (L, c, e);
+        else if (k[0] == 'v') read_v (L, c, e);
+        else if (k[0] == 'l') read_l (L, c, e);
+        else if (k[0] == 'o') read_o (L, c, e);
+        else if (k[0] == 'g') read_g (L, c, e);
+        else if (k[0] == 's')
         {
-            if (O->sv[si].pc > 0)
-            {
-                glGenBuffers(1, &O->sv[si].pibo);
-                glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, O->sv[si].pibo);
-                glBufferData(GL_ELEMENT_ARRAY_BUFFER, O->sv[si].pc * ps,
-                                        O->sv[si].pv, GL_STATIC_DRAW);
-            }
-
-            if (O->sv[si].lc > 0)
-            {
-                glGenBuffers(1, &O->sv[si].libo);
-                glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, O->sv[si].libo);
-                glBufferData(GL_ELEMENT_ARRAY_BUFFER, O->sv[si].lc * ls,
-                                        O->sv[si].lv, GL_STATIC_DRAW);
-            }
+            L->gi = 0;
+            scan_int(&c, e, &L->gi);
         }
+        break;
 
-        /* Enable and bind the attributes. */
-
-        if (O->uloc >= 0)
+    case 2:
+        if (k[0] == 'v')
         {
-            glEnableVertexAttribArray(O->uloc);
-            glVertexAttribPointer(O->uloc, 3, GL_FLOAT, GL_FALSE, vs, (const GLvoid *)  0);
-        }
-        if (O->nloc >= 0)
-        {
-            glEnableVertexAttribArray(O->nloc);
-            glVertexAttribPointer(O->nloc, 3, GL_FLOAT, GL_FALSE, vs, (const GLvoid *) 12);
-        }
-        if (O->tloc >= 0)
-        {
-            glEnableVertexAttribArray(O->tloc);
-            glVertexAttribPointer(O->tloc, 2, GL_FLOAT, GL_FALSE, vs, (const GLvoid *) 24);
-        }
-        if (O->vloc >= 0)
-        {
-            glEnableVertexAttribArray(O->vloc);
-            glVertexAttribPointer(O->vloc, 3, GL_FLOAT, GL_FALSE, vs, (const GLvoid *) 32);
+            if      (k[1] == 't') read_vt(L, c, e);
+            else if (k[1] == 'n') read_vn(L, c, e);
         }
+        break;
+
+    case 6:
+        if      (memcmp(k, "mtllib", 6) == 0) read_mtllib(L, c, e);
+        else if (memcmp(k, "usemtl", 6) == 0) read_usemtl(L, c, e);
+        break;
     }
-#endif
+    return 0;
+}
+
+static int read_step(struct obj_load *L, size_t n)
+{
+    /* Count bytes read, reporting at each megabyte. */
+
+    if ((L->nb += n) >= L->nr)
+    {
+        L->nr = L->nb + MAXBUF;
+
+        if (report(L->O, OBJ_PROG_READ, L->nb, L->nt))
+            L->halt = 1;
+    }
+    return L->halt;
+}
+
+static int read_line_step(void *data, const char *c, const char *e)
+{
+    struct obj_load *L = (struct obj_load *) data;
+
+    /* Parse a line and count it, with its newline, toward progress. */
+
+    read_line(L, c, e);
+
+    return read_step(L, (size_t) (e - c) + 1);
 }
 
 /*----------------------------------------------------------------------------*/
+/* Parallel reader                                                            */
 
-int obj_cmp_vert(obj *O, int vi, int vj, float eps, float dot)
+/* The file is split into newline-aligned chunks, and each chunk's vertex     */
+/* data and face indices are parsed concurrently. Face and state records are  */
+/* then replayed serially in file order, each with the vector caches rewound  */
+/* to their extent at that line. The result is identical to a serial read.    */
+
+#ifndef CONF_NO_THREADS
+
+struct obj_event
 {
-    if (fabs(O->vv[vi].v[0] - O->vv[vj].v[0]) >= eps) return 0;
-    if (fabs(O->vv[vi].v[1] - O->vv[vj].v[1]) >= eps) return 0;
-    if (fabs(O->vv[vi].v[2] - O->vv[vj].v[2]) >= eps) return 0;
+    const char *c;              /* Start of a deferred line              */
+    const char *e;              /* End of a deferred line                */
+
+    int ii;                     /* First face index set in the chunk     */
+    int ic;                     /* Face index set count, -1 if deferred  */
+    int vc;                     /* Chunk positions preceding this line   */
+    int tc;                     /* Chunk texcoords preceding this line   */
+    int nc;                     /* Chunk normals preceding this line     */
+};
 
-    if (fabs(O->vv[vi].t[0] - O->vv[vj].t[0]) >= eps) return 0;
-    if (fabs(O->vv[vi].t[1] - O->vv[vj].t[1]) >= eps) return 0;
+struct obj_chunk
+{
+    const char *c;
+    const char *e;
+
+    pthread_t thread;
+    int       joinable;
+
+    int vc, vm;
+    int tc, tm;
+    int nc, nm;
+    int ic, im;
+    int ec, em;
+
+    struct vec3      *vv;
+    struct vec2      *tv;
+    struct vec3      *nv;
+    int              *iv;
+    struct obj_event *ev;
+};
 
-    if (O->vv[vi].n[0] * O->vv[vj].n[0] +
-        O->vv[vi].n[1] * O->vv[vj].n[1] +
-        O->vv[vi].n[2] * O->vv[vj].n[2] < dot) return 0;
+static int add_event(struct obj_chunk *C, const char *c, const char *e, int ic)
+{
+    int ei;
 
-    return 1;
+    if ((ei = add__((void **) &C->ev, &C->ec, &C->em,
+                                   sizeof (struct obj_event))) >= 0)
+    {
+        C->ev[ei].c  = c;
+        C->ev[ei].e  = e;
+        C->ev[ei].ii = C->ic;
+        C->ev[ei].ic = ic;
+        C->ev[ei].vc = C->vc;
+        C->ev[ei].tc = C->tc;
+        C->ev[ei].nc = C->nc;
+    }
+    return ei;
 }
 
-void obj_swp_vert(obj *O, int vi, int vj)
+static void read_chunk_f(struct obj_chunk *C, const char *c, const char *e)
 {
-    int si;
-    int pi;
-    int li;
+    const char *d;
 
-    /* Replace all occurrences of vi with vj. */
+    int _vi;
+    int _ti;
+    int _ni;
+    int  ei;
+    int  ii;
 
-    for (si = 0; si < O->sc; ++si)
+    /* Parse the face index sets for later conversion to vertices. */
+
+    if ((ei = add_event(C, c, e, 0)) >= 0)
+
+        while ((d = read_poly_indices(c, e, &_vi, &_ti, &_ni)))
+        {
+            if ((ii = add__((void **) &C->iv, &C->ic, &C->im,
+                                              3 * sizeof (int))) >= 0)
+            {
+                C->iv[3 * ii + 0] = _vi;
+                C->iv[3 * ii + 1] = _ti;
+                C->iv[3 * ii + 2] = _ni;
+                C->ev[ei].ic++;
+            }
+            c = d;
+        }
+}
+
+static int read_chunk_line(void *data, const char *c, const char *e)
+{
+    struct obj_chunk *C = (struct obj_chunk *) data;
+
+    const char *k = skip_space(c, e);
+    const char *d = skip_word (k, e);
+
+    int i;
+
+    /* Parse vertex data and face indices. Defer all state changes. */
+
+    switch (d - k)
     {
-        for (pi = 0; pi < O->sv[si].pc; ++pi)
+    case 1:
+        if (k[0] == 'v')
         {
-            if (O->sv[si].pv[pi].vi[0] == vi)
-                O->sv[si].pv[pi].vi[0] =  vj;
-            if (O->sv[si].pv[pi].vi[1] == vi)
-                O->sv[si].pv[pi].vi[1] =  vj;
-            if (O->sv[si].pv[pi].vi[2] == vi)
-                O->sv[si].pv[pi].vi[2] =  vj;
+            if ((i = add__((void **) &C->vv, &C->vc, &C->vm,
+                                         sizeof (struct vec3))) >= 0)
+            {
+                memset(C->vv + i, 0, sizeof (struct vec3));
+                scan_floats(&d, e, C->vv[i].v, 3);
+                C->vv[i]._ii = -1;
+            }
         }
-        for (li = 0; li < O->sv[si].lc; ++li)
+        else if (k[0] == 'f')
+            read_chunk_f(C, d, e);
+        else if (k[0] == 'l' || k[0] == 's' || k[0] == 'o' || k[0] == 'g')
+            add_event(C, c, e, -1);
+        break;
+
+    case 2:
+        if (k[0] == 'v' && k[1] == 't')
         {
-            if (O->sv[si].lv[li].vi[0] == vi)
-                O->sv[si].lv[li].vi[0] =  vj;
-            if (O->sv[si].lv[li].vi[1] == vi)
-                O->sv[si].lv[li].vi[1] =  vj;
+            if ((i = add__((void **) &C->tv, &C->tc, &C->tm,
+                                         sizeof (struct vec2))) >= 0)
+            {
+                memset(C->tv + i, 0, sizeof (struct vec2));
+                scan_floats(&d, e, C->tv[i].v, 2);
+            }
+        }
+        else if (k[0] == 'v' && k[1] == 'n')
+        {
+            if ((i = add__((void **) &C->nv, &C->nc, &C->nm,
+                                         sizeof (struct vec3))) >= 0)
+            {
+                memset(C->nv + i, 0, sizeof (struct vec3));
+                scan_floats(&d, e, C->nv[i].v, 3);
+            }
         }
+        break;
+
+    case 6:
+        if (is_word(k, d, "mtllib") || is_word(k, d, "usemtl"))
+            add_event(C, c, e, -1);
+        break;
     }
+    return 0;
 }
 
-void obj_uniq(obj *O, float eps, float dot, int verbose)
+static void *read_chunk(void *data)
 {
-    int vc = O->vc;
-    int vi;
-    int vj;
-    int di;
+    struct obj_chunk *C = (struct obj_chunk *) data;
 
-    /* Merge all vertices within epsilon of one another. */
+    read_lines(read_chunk_line, C, C->c, C->e);
 
-    for (vi = 0; vi < O->vc; vi += di)
+    return NULL;
+}
+
+static void read_chunk_merge(struct obj_load *L, struct obj_chunk *C, int n)
+{
+    int vc, vb = L->_vc;
+    int tc, tb = L->_tc;
+    int nc, nb = L->_nc;
+
+    int i;
+    int j;
+    int k;
+
+    /* Append all chunk vector data to the vector caches, in order. */
+
+    for (i = 0; i < n; ++i)
     {
-        di = 1;
+        for (j = 0; j < C[i].vc; ++j)
+            if ((k = add_v(L)) >= 0) L->_vv[k] = C[i].vv[j];
+        for (j = 0; j < C[i].tc; ++j)
+            if ((k = add_t(L)) >= 0) L->_tv[k] = C[i].tv[j];
+        for (j = 0; j < C[i].nc; ++j)
+            if ((k = add_n(L)) >= 0) L->_nv[k] = C[i].nv[j];
+    }
 
-        for (vj = 0; vj < vi; ++vj)
+    vc = L->_vc;
+    tc = L->_tc;
+    nc = L->_nc;
+
+    /* Replay each face and deferred line in order. */
+
+    for (i = 0; i < n && L->halt == 0; ++i)
+    {
+        const char *f = C[i].c;
+
+        for (j = 0; j < C[i].ec && L->halt == 0; ++j)
         {
-            if (obj_cmp_vert(O, vi, vj, eps, dot))
+            const struct obj_event *E = C[i].ev + j;
+
+            /* Rewind the vector caches to their extent at this line. */
+
+            L->_vc = vb + E->vc;
+            L->_tc = tb + E->tc;
+            L->_nc = nb + E->nc;
+
+            if (E->ic < 0)
+                read_line(L, E->c, E->e);
+            else if (L->sel)
             {
-                if (verbose) printf("%d %d\n", vi, vc--);
+                const int *iv = C[i].iv + 3 * E->ii;
 
-                obj_swp_vert(O, vi, vj);
-                obj_del_vert(O, vi);
+                int ic = 0;
 
-                di = 0;
-                break;
+                L->_ic = 0;
+
+                for (k = 0; k < E->ic; ++k)
+                    if (read_poly_vertex(L, iv[3 * k + 0],
+                                            iv[3 * k + 1],
+                                            iv[3 * k + 2]) >= 0)
+                        ic++;
+
+                read_poly(L, ic);
+            }
+
+            /* Count the bytes through this line toward progress. */
+
+            if (L->O->pfn)
+            {
+                read_step(L, (size_t) (E->e - f));
+                f = E->e;
             }
         }
+        if (L->O->pfn && L->halt == 0)
+            read_step(L, (size_t) (C[i].e - f));
+
+        vb += C[i].vc;
+        tb += C[i].tc;
+        nb += C[i].nc;
     }
-}
 
-/*----------------------------------------------------------------------------*/
+    L->_vc = vc;
+    L->_tc = tc;
+    L->_nc = nc;
+}
 
-void obj_sort(obj *O, int qc)
+static void read_text_threads(struct obj_load *L, const char *c,
+                                                  const char *e, int n)
 {
-    const int vc = O->vc;
+    struct obj_chunk *C;
 
-    struct vert
-    {
-        int  qs;    /* Cache insertion serial number */
-        int *iv;    /* Polygon reference list buffer */
-        int  ic;    /* Polygon reference list length */
-    };
+    const char *f = e;
+    const char *d;
 
-    /* Vertex optimization data; vertex FIFO cache */
+    int i;
 
-    struct vert *vv = (struct vert *) malloc(vc * sizeof (struct vert));
-    int         *qv = (int         *) malloc(qc * sizeof (int        ));
+    /* Find the end of the last complete line. */
 
-    int qs = 1;   /* Current cache insertion serial number */
-    int qi = 0;   /* Current cache insertion point [0, qc) */
+    while (f > c && f[-1] != '\n')
+        f--;
 
-    int si;
-    int pi;
-    int vi;
-    int ii;
-    int qj;
+    if ((C = (struct obj_chunk *) calloc(n, sizeof (struct obj_chunk))))
+    {
+        /* Divide the complete lines into chunks at line boundaries. */
 
-    /* Initialize the vertex cache to empty. */
+        for (i = 0; i < n; ++i)
+        {
+            C[i].c = (i == 0)     ? c : C[i - 1].e;
+            C[i].e = (i == n - 1) ? f : c + (f - c) / n * (i + 1);
 
-    for (qj = 0; qj < qc; ++qj)
-        qv[qj] = -1;
+            if (C[i].e < C[i].c)
+                C[i].e = C[i].c;
 
-    /* Process each surface of this file in turn. */
+            if ((d = (const char *) memchr(C[i].e, '\n', f - C[i].e)))
+                C[i].e = d + 1;
+            else
+                C[i].e = f;
+        }
 
-    for (si = 0; si < O->sc; ++si)
-    {
-        const int pc = O->sv[si].pc;
+        /* Parse all chunks concurrently, using this thread for the first. */
 
-        /* Allocate the polygon reference list buffers. */
+        for (i = 1; i < n; ++i)
+            C[i].joinable = !pthread_create(&C[i].thread, NULL,
+                                            read_chunk, C + i);
+        read_chunk(C);
 
-        int *ip, *iv = (int *) malloc(3 * pc * sizeof (int));
+        for (i = 1; i < n; ++i)
+            if (C[i].joinable)
+                pthread_join(C[i].thread, NULL);
+            else
+                read_chunk(C + i);
 
-        /* Count the number of polygon references per vertex. */
+        /* Convert the results and release the chunk buffers. */
 
-        memset(vv, 0, vc * sizeof (struct vert));
+        read_chunk_merge(L, C, n);
 
-        for (pi = 0; pi < pc; ++pi)
+        for (i = 0; i < n; ++i)
         {
-            const index_t *i = O->sv[si].pv[pi].vi;
-
-            vv[i[0]].ic++;
-            vv[i[1]].ic++;
-            vv[i[2]].ic++;
+            free(C[i].vv);
+            free(C[i].tv);
+            free(C[i].nv);
+            free(C[i].iv);
+            free(C[i].ev);
         }
+        free(C);
+    }
 
-        /* Initialize all vertex optimization data. */
+    /* Process any unterminated final line. */
 
-        for (vi = 0, ip = iv; vi < vc; ++vi)
+    if (L->halt == 0)
+        read_last(read_line, L, f, e);
+}
+
+static int read_file_threads(struct obj_load *L, const char *filename,
+                                                 unsigned int opt, int n)
+{
+    char  *p;
+    size_t s;
+
+#ifndef CONF_NO_MMAP
+    if (opt & OBJ_READ_MMAP)
+    {
+        if (map_file(filename, &p, &s))
         {
-            vv[vi].qs = -qc;
-            vv[vi].iv =  ip;
-            ip += vv[vi].ic;
-            vv[vi].ic =   0;
+            if (p) read_text_threads(L, p, p + s, n);
+            unmap_file(p, s);
+            return 1;
         }
+        return 0;
+    }
+#endif
+    if (load_file(filename, &p, &s))
+    {
+        read_text_threads(L, p, p + s, n);
+        free(p);
+        return 1;
+    }
+    return 0;
+}
 
-        /* Fill the polygon reference list buffers. */
+#endif
 
-        for (pi = 0; pi < pc; ++pi)
-        {
-            const index_t *i = O->sv[si].pv[pi].vi;
+/*----------------------------------------------------------------------------*/
 
-            vv[i[0]].iv[vv[i[0]].ic++] = pi;
-            vv[i[1]].iv[vv[i[1]].ic++] = pi;
-            vv[i[2]].iv[vv[i[2]].ic++] = pi;
-        }
+static int init_load(struct obj_load *L, obj *O)
+{
+    /* Begin with empty vector caches. */
 
-        /* Iterate over the polygon array of this surface. */
+    memset(L, 0, sizeof (struct obj_load));
 
-        for (pi = 0; pi < pc; ++pi)
-        {
-            const index_t *i = O->sv[si].pv[pi].vi;
+    /* Take any mapped arrays to the heap, where loading may grow them. */
 
-            int qd = qs - qc;
+    if (own_map(O) == 0)
+        return 0;
 
-            int dk = -1;    /* The best polygon score */
-            int pk = pi;    /* The best polygon index */
+    /* Ensure there exists a default surface 0 and default material 0. */
 
-            /* Find the best polygon among those referred-to by the cache. */
+    L->O  = O;
+    L->si = obj_add_surf(O);
 
-            for (qj = 0; qj < qc; ++qj)
-                if (qv[qj] >= 0)
+    obj_set_surf(O, L->si, obj_add_mtrl(O));
 
-                    for (ii = 0;  ii < vv[qv[qj]].ic; ++ii)
-                    {
-                        int pj = vv[qv[qj]].iv[ii];
-                        int dj = 0;
+    /* Faces preceding any object or group name are in group "default". */
 
-                        const index_t *j = O->sv[si].pv[pj].vi;
+    if (O->sfn)
+        L->gs = O->sfn(O->sdata, OBJ_NAME_GROUP, "default");
 
-                        /* Recently-used vertex bonus. */
+    L->sel = (O->sfn == NULL) || L->gs;
 
-                        if (vv[j[0]].qs > qd) dj += vv[j[0]].qs - qd;
-                        if (vv[j[1]].qs > qd) dj += vv[j[1]].qs - qd;
-                        if (vv[j[2]].qs > qd) dj += vv[j[2]].qs - qd;
+    return 1;
+}
 
-                        /* Low-valence vertex bonus. */
+static int scan_line(void *data, const char *c, const char *e)
+{
+    struct obj_load *L = (struct obj_load *) data;
 
-                        dj -= vv[j[0]].ic;
-                        dj -= vv[j[1]].ic;
-                        dj -= vv[j[2]].ic;
+    const char *k = skip_space(c, e);
+    const char *d = skip_word (k, e);
 
-                        if (dk < dj)
-                        {
-                            dk = dj;
-                            pk = pj;
-                        }
-                    }
+    char name[MAXSTR];
 
-            if (pk != pi)
-            {
-                struct obj_poly temp;
+    struct mtl_use *u;
 
-                /* Update the polygon reference list. */
+    int n = 0;
 
-                for (vi = 0; vi < 3; ++vi)
-                    for (ii = 0; ii < vv[i[vi]].ic; ++ii)
-                        if (vv[i[vi]].iv[ii] == pi)
-                        {
-                            vv[i[vi]].iv[ii] =  pk;
-                            break;
-                        }
+    /* Count vector records, and face and line corners per material. */
 
-                /* Swap the best polygon into the current position. */
+    switch (d - k)
+    {
+    case 1:
+        if (k[0] == 'v')
+            L->vn++;
 
-                temp             = O->sv[si].pv[pi];
-                O->sv[si].pv[pi] = O->sv[si].pv[pk];
-                O->sv[si].pv[pk] =  temp;
+        else if (k[0] == 'f' || k[0] == 'l')
+        {
+            while ((d = skip_space(d, e)) < e)
+            {
+                d = skip_word(d, e);
+                n++;
             }
+            L->in += n;
 
-            /* Iterate over the current polygon's vertices. */
+            if (k[0] == 'f' && n > 2) *L->pp += n - 2;
+            if (k[0] == 'l' && n > 1) *L->lp += n - 1;
+        }
+        break;
 
-            for (vi = 0; vi < 3; ++vi)
-            {
-                struct vert *vp = vv + i[vi];
+    case 2:
+        if      (k[0] == 'v' && k[1] == 't') L->tn++;
+        else if (k[0] == 'v' && k[1] == 'n') L->nn++;
+        break;
 
-                /* If this vertex was a cache miss then queue it. */
+    case 6:
+        if (is_word(k, d, "usemtl"))
+        {
+            scan_word(&d, e, name);
 
-                if (qs - vp->qs >= qc)
-                {
-                    vp->qs = qs++;
-                    qv[qi] = i[vi];
+            if ((u = get_mtl_use(L, name)))
+            {
+                L->pp = &u->pc;
+                L->lp = &u->lc;
+            }
+        }
+        break;
+    }
+    return 0;
+}
+
+static void scan_obj(struct obj_load *L, const char *filename)
+{
+    obj *O = L->O;
+    int  n;
+
+    L->pp = &L->pn;
+    L->lp = &L->ln;
+
+    /* Count the file's records and size all arrays to receive them. */
+
+    if (read_file(filename, O->ropt, scan_line, L))
+    {
+        reserve__((void **) &L->_vv, &L->_vm, sizeof (struct vec3), L->vn);
+        reserve__((void **) &L->_tv, &L->_tm, sizeof (struct vec2), L->tn);
+        reserve__((void **) &L->_nv, &L->_nm, sizeof (struct vec3), L->nn);
+        reserve__((void **) &L->_sv, &L->_sm, sizeof (struct iset), L->vn);
+
+        /* Welded vertices usually number about as many as the largest of */
+        /* the vector counts, and never more than the corners.            */
+
+        n = L->vn;
+
+        if (n < L->tn) n = L->tn;
+        if (n < L->nn) n = L->nn;
+
+        L->vx = O->vc + L->in;
+
+        reserve_vert(O, O->vc + n);
+
+        reserve_surf(O, L->si, L->pn, L->ln);
+    }
+}
+
+static void trim_vert(obj *O)
+{
+    void **p;
+    void  *v;
+    size_t s;
+    int    k;
+
+    /* Return vertex storage reserved beyond the loaded count. */
+
+    if (O->vc < O->vm && O->vc > 0)
+    {
+        for (k = 0; k < VERT_ARRAYS; ++k)
+        {
+            p = vert_array(O, k, &s);
+
+            if ((v = realloc(*p, O->vc * s)))
+                *p = v;
+        }
+
+        O->vm = O->vc;
+    }
+}
+
+static int read_obj(obj *O, const char *filename, int defer, char **dep)
+{
+    struct obj_load L;
+    struct stat     st;
+
+    int r;
+
+    if (init_load(&L, O) == 0)
+        return 0;
+
+    L.defer = defer;
+    L.dep   = dep ? *dep : NULL;
+
+    if (stat(filename, &st) == 0)
+        L.nt = (size_t) st.st_size;
+
+    /* Extract the directory from the filename for use in MTL loading. */
+
+    strncpy(L.dir, filename, MAXSTR - 1);
+    dirpath(L.dir);
+
+    /* Prescan the file, if requested and the arrays may be reserved. */
+
+    if ((O->ropt & OBJ_READ_SCAN) && O->bp == NULL)
+        scan_obj(&L, filename);
+
+    /* Add the named file to the given object. */
+
+#ifndef CONF_NO_THREADS
+    if (O->threads > 1)
+        r = read_file_threads(&L, filename, O->ropt, O->threads);
+    else
+#endif
+        r = read_file(filename, O->ropt, O->pfn ? read_line_step
+                                                : read_line, &L);
+
+    /* Release the vector caches and any unused prescanned vertices. */
+
+    free_load(&L);
+
+    if (O->ropt & OBJ_READ_SCAN)
+        trim_vert(O);
+
+    if (dep)
+        *dep = L.dep;
+
+    return L.halt ? -1 : r;
+}
+
+/*----------------------------------------------------------------------------*/
+/* Probe                                                                      */
+
+/* A probe scans an OBJ and its MTL libraries for counts, bounds, and names   */
+/* without building an object. It holds nothing but the line buffer.          */
+
+struct probe
+{
+    struct obj_info *I;
+    obj_reporter     fn;
+    void            *data;
+    char             dir[MAXSTR];
+};
+
+static int probe_mtl_line(void *data, const char *c, const char *e)
+{
+    struct probe *P = (struct probe *) data;
+
+    const char *k = skip_space(c, e);
+    const char *d = skip_word (k, e);
+
+    unsigned int clamp;
+
+    float o[3];
+    float s[3];
+
+    char map[MAXSTR];
+
+    /* Report the image named by each property map. */
+
+    if (d - k == 6 && memcmp(k, "map_", 4) == 0)
+    {
+        scan_map(d, e, map, &clamp, o, s);
+
+        if (map[0] && P->fn)
+            P->fn(P->data, OBJ_NAME_MAP, map);
+    }
+    return 0;
+}
+
+static void probe_mtllib(struct probe *P, const char *c, const char *e)
+{
+    char pathname[MAXSTR];
+    char file[MAXSTR];
+
+    /* Report and scan each named library. */
+
+    while (scan_word(&c, e, file))
+    {
+        P->I->mc++;
+
+        if (P->fn)
+            P->fn(P->data, OBJ_NAME_MTLLIB, file);
+
+        /* Skip a library whose path name does not fit. */
+
+        if (snprintf(pathname, MAXSTR, "%s/%s", P->dir, file) < MAXSTR)
+            read_file(pathname, 0, probe_mtl_line, P);
+    }
+}
+
+static void probe_v(struct obj_info *I, const char *c, const char *e)
+{
+    float *b = I->bound;
+    float  v[3] = { 0.0f, 0.0f, 0.0f };
+
+    /* Count a vertex position and include it in the bounding box. */
+
+    scan_floats(&c, e, v, 3);
+
+    if (I->vc++ == 0)
+    {
+        b[0] = b[3] = v[0];
+        b[1] = b[4] = v[1];
+        b[2] = b[5] = v[2];
+    }
+    else
+    {
+        if (b[0] > v[0]) b[0] = v[0];
+        if (b[1] > v[1]) b[1] = v[1];
+        if (b[2] > v[2]) b[2] = v[2];
+
+        if (b[3] < v[0]) b[3] = v[0];
+        if (b[4] < v[1]) b[4] = v[1];
+        if (b[5] < v[2]) b[5] = v[2];
+    }
+}
+
+static int probe_line(void *data, const char *c, const char *e)
+{
+    struct probe    *P = (struct probe *) data;
+    struct obj_info *I = P->I;
+
+    const char *k = skip_space(c, e);
+
+    char name[MAXSTR];
+
+    int n = 0;
+
+    /* Isolate the keyword and dispatch on its length and leading bytes. */
+
+    switch ((c = skip_word(k, e)) - k)
+    {
+    case 1:
+        if (k[0] == 'v')
+            probe_v(I, c, e);
+
+        else if (k[0] == 'o' && P->fn)
+        {
+            if (scan_word(&c, e, name))
+                P->fn(P->data, OBJ_NAME_OBJECT, name);
+        }
+        else if (k[0] == 'g' && P->fn)
+        {
+            while (scan_word(&c, e, name))
+                P->fn(P->data, OBJ_NAME_GROUP, name);
+        }
+
+        else if (k[0] == 'f' || k[0] == 'l')
+        {
+            while ((c = skip_space(c, e)) < e)
+            {
+                c = skip_word(c, e);
+                n++;
+            }
+
+            if (k[0] == 'f')
+            {
+                I->fc++;
+                if (n > 2) I->pc += n - 2;
+            }
+            else
+            {
+                I->lc++;
+                if (n > 1) I->sc += n - 1;
+            }
+        }
+        break;
+
+    case 2:
+        if      (k[0] == 'v' && k[1] == 't') I->tc++;
+        else if (k[0] == 'v' && k[1] == 'n') I->nc++;
+        break;
+
+    case 6:
+        if (memcmp(k, "mtllib", 6) == 0)
+            probe_mtllib(P, c, e);
+
+        else if (memcmp(k, "usemtl", 6) == 0)
+        {
+            I->uc++;
+
+            if (P->fn && scan_word(&c, e, name))
+                P->fn(P->data, OBJ_NAME_USEMTL, name);
+        }
+        break;
+    }
+    return 0;
+}
+
+/*----------------------------------------------------------------------------*/
+
+static int in_map(const obj *O, const void *p)
+{
+    const char *c = (const char *) p;
+
+    /* Determine whether an array lies within the object's mapped snapshot. */
+
+    return (O->bp && c >= O->bp && c < O->bp + O->bn);
+}
+
+static int own_array(const obj *O, void **p, size_t n)
+{
+    void *q;
+
+    /* Replace a mapped array with a heap copy. */
+
+    if (in_map(O, *p))
+    {
+        if ((q = malloc(n)) == NULL)
+            return 0;
+
+        memcpy(q, *p, n);
+        *p = q;
+    }
+    return 1;
+}
+
+static void unmap_obj(obj *O)
+{
+    void **p;
+    size_t s;
+    int    si;
+    int    k;
+
+    /* Forget any arrays still in the mapped snapshot and release it. */
+
+    if (O->bp)
+    {
+        for (k = 0; k < VERT_ARRAYS; ++k)
+        {
+            p = vert_array(O, k, &s);
+
+            if (in_map(O, *p))
+                *p = NULL;
+        }
+
+        for (si = 0; si < O->sc; ++si)
+        {
+            if (in_map(O, O->sv[si].pv)) O->sv[si].pv = NULL;
+            if (in_map(O, O->sv[si].lv)) O->sv[si].lv = NULL;
+        }
+#ifndef CONF_NO_MMAP
+        munmap(O->bp, O->bn);
+#endif
+        O->bp = NULL;
+        O->bn = 0;
+    }
+}
+
+static int own_map(obj *O)
+{
+    struct obj_surf *sp;
+
+    void **p;
+    size_t s;
+    int    si;
+    int    k;
+
+    /* Copy each mapped array to the heap so that it may grow, then unmap. */
+
+    if (O->bp)
+    {
+        for (k = 0; k < VERT_ARRAYS; ++k)
+        {
+            p = vert_array(O, k, &s);
+
+            if (!own_array(O, p, O->vc * s))
+                return 0;
+        }
+
+        for (si = 0; si < O->sc; ++si)
+        {
+            sp = O->sv + si;
+
+            if (!own_array(O, (void **) &sp->pv,
+                           sp->pc * sizeof (struct obj_poly)) ||
+                !own_array(O, (void **) &sp->lv,
+                           sp->lc * sizeof (struct obj_line)))
+                return 0;
+        }
+        unmap_obj(O);
+    }
+    return 1;
+}
+
+static void obj_rel_mtrl(struct obj_mtrl *mp)
+{
+    /* Release any resources held by this material. */
+
+    int ki;
+
+    for (ki = 0; ki < OBJ_PROP_COUNT; ki++)
+    {
+        if (mp->kv[ki].str) free(mp->kv[ki].str);
+
+        put_image(mp->kv[ki].img);
+    }
+}
+
+static void obj_rel_surf(struct obj_surf *sp)
+{
+#ifndef CONF_NO_GL
+    if (sp->pibo) glDeleteBuffers(1, &sp->pibo);
+    if (sp->libo) glDeleteBuffers(1, &sp->libo);
+#endif
+
+    sp->pibo = 0;
+    sp->libo = 0;
+
+    /* Release this surface's polygon and line vectors. */
+
+    if (sp->pv) free(sp->pv);
+    if (sp->lv) free(sp->lv);
+}
+
+static void obj_rel(obj *O)
+{
+    int si;
+    int mi;
+
+    /* Release resources held by this file and it's materials and surfaces. */
+
+#ifndef CONF_NO_GL
+    if (O->vbo) glDeleteBuffers     (1, &O->vbo);
+    if (O->vao) glDeleteVertexArrays(1, &O->vao);
+#endif
+
+    O->vbo = 0;
+
+    unmap_obj(O);
+
+    for (mi = 0; mi < O->mc; ++mi) obj_rel_mtrl(O->mv + mi);
+    for (si = 0; si < O->sc; ++si) obj_rel_surf(O->sv + si);
+}
+
+/*----------------------------------------------------------------------------*/
+/* Cache                                                                      */
+
+/* The cache directory holds a snapshot of each processed OBJ, named by a     */
+/* hash of the OBJ's full path and the processing options. A snapshot's key   */
+/* lists those options and the size and modification time of the OBJ and of   */
+/* each MTL file it read, and the snapshot is used only while all still hold. */
+/* Entries are written to a private temporary file and renamed into place, so */
+/* concurrent processes may share one directory.                              */
+
+/* The settings are global, so they are guarded, and each read works from  */
+/* its own copy.                                                            */
+
+static char *cache_dir;
+static float cache_eps;
+static float cache_dot;
+static int   cache_qc;
+
+#ifndef CONF_NO_THREADS
+static pthread_mutex_t cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static void get_cache(struct cache_opt *K)
+{
+#ifndef CONF_NO_THREADS
+    pthread_mutex_lock(&cache_mutex);
+#endif
+    if (cache_dir && strlen(cache_dir) + 32 < MAXSTR)
+        strcpy(K->dir, cache_dir);
+    else
+        K->dir[0] = '\0';
+
+    K->eps = cache_eps;
+    K->dot = cache_dot;
+    K->qc  = cache_qc;
+#ifndef CONF_NO_THREADS
+    pthread_mutex_unlock(&cache_mutex);
+#endif
+}
+
+struct cache_halt
+{
+    obj_progress fn;            /* Application progress callback        */
+    void        *data;          /* Application progress data            */
+    int          halt;          /* The application asked to stop        */
+};
+
+static int cache_progress(void *data, int stage, size_t i, size_t n)
+{
+    struct cache_halt *C = (struct cache_halt *) data;
+
+    /* Pass progress along, noting any request to stop. */
+
+    if (C->fn(C->data, stage, i, n))
+        C->halt = 1;
+
+    return C->halt;
+}
+
+static int full_path(char *dst, const char *src)
+{
+#ifdef _WIN32
+    return (_fullpath(dst, src, MAXSTR) != NULL);
+#else
+    char *p;
+    int   r = 0;
+
+    if ((p = realpath(src, NULL)))
+    {
+        if (strlen(p) < MAXSTR)
+        {
+            strcpy(dst, p);
+            r = 1;
+        }
+        free(p);
+    }
+    return r;
+#endif
+}
+
+static uint64_t hash_key(const char *str, uint64_t h)
+{
+    /* Fold a string into a 64-bit FNV-1a hash. */
+
+    while (*str)
+    {
+        h ^= (unsigned char) *str++;
+        h *= UINT64_C(1099511628211);
+    }
+    return h;
+}
+
+static int check_dep(void *data, const char *c, const char *e)
+{
+    char path[MAXSTR];
+    char rec[MAXSTR + 64];
+
+    const char *d = skip_space(skip_word(skip_space(skip_word(c, e), e), e), e);
+
+    (void) data;
+
+    /* Stop at any record that no longer describes its file. */
+
+    if (e - d >= MAXSTR)
+        return 1;
+
+    memcpy(path, d, e - d);
+    path[e - d] = '\0';
+
+    dep_rec(rec, path);
+
+    return (memcmp(rec, c, e - c) || rec[e - c] != '\n' || rec[e - c + 1]);
+}
+
+static int check_key(const char *str, const char *key)
+{
+    size_t n = strlen(key);
+    size_t m = strlen(str);
+
+    /* Match the expected options and OBJ, then confirm each MTL file. */
+
+    if (m >= n && memcmp(str, key, n) == 0)
+        return (read_lines(check_dep, NULL, str + n, str + m) == str + m);
+
+    return 0;
+}
+
+static int use_cache(const obj *O, const struct cache_opt *K,
+                     const char *filename, char *full, char *path, char *key)
+{
+    uint64_t h;
+
+    /* Cache only whole reads into an empty object. */
+
+    if (K->dir[0] == '\0' || O->mc || O->vc || O->sc || O->sfn)
+        return 0;
+
+    if (full_path(full, filename) == 0)
+        return 0;
+
+    /* Name the entry by the options and path, then key it by the OBJ too. */
+
+    sprintf(key, "obj %.9g %.9g %d\n", K->eps, K->dot, K->qc);
+
+    h = hash_key(full, hash_key(key, UINT64_C(14695981039346656037)));
+
+    if (snprintf(path, MAXSTR, "%s/%08lx%08lx.bin", K->dir,
+                 (unsigned long) (h >> 32),
+                 (unsigned long) (h & 0xFFFFFFFF)) >= MAXSTR)
+        return 0;
+
+    dep_rec(key + strlen(key), full);
+
+    return 1;
+}
+
+static int read_cache(obj *O, const char *path, const char *key, int defer)
+{
+    void **p;
+    void **q;
+    size_t s;
+    obj   *T;
+    int    r = 0;
+    int    k;
+
+    /* Read the entry aside and take its contents only if it is current. */
+
+    if ((T = obj_create(NULL)))
+    {
+        if ((r = read_bin(T, path, key, defer)))
+        {
+            free(O->mv);
+            free(O->sv);
+
+            for (k = 0; k < VERT_ARRAYS; ++k)
+            {
+                p = vert_array(O, k, &s);
+                q = vert_array(T, k, &s);
+
+                free(*p);
+                *p = *q;
+                *q = NULL;
+            }
+
+            O->mv = T->mv; O->mc = T->mc; O->mm = T->mm;
+            O->sv = T->sv; O->sc = T->sc; O->sm = T->sm;
+                           O->vc = T->vc; O->vm = T->vm;
+
+            T->mv = NULL; T->mc = T->mm = 0;
+            T->sv = NULL; T->sc = T->sm = 0;
+                          T->vc = T->vm = 0;
+        }
+        obj_delete(T);
+    }
+    return r;
+}
+
+static void write_cache(const obj *O, const char *path, const char *key)
+{
+    char tmp[MAXSTR + 64];
+
+    /* Write a private temporary and atomically replace the entry with it. */
+
+    sprintf(tmp, "%s.%ld.%p.tmp", path, (long) getpid(), (const void *) O);
+
+    if (write_bin(O, tmp, key) == 0 || rename(tmp, path) != 0)
+        remove(tmp);
+}
+
+void obj_set_cache(const char *dir, float eps, float dot, int qc)
+{
+#ifndef CONF_NO_THREADS
+    pthread_mutex_lock(&cache_mutex);
+#endif
+    cache_dir = set_name(cache_dir, dir);
+    cache_eps = eps;
+    cache_dot = dot;
+    cache_qc  = qc;
+#ifndef CONF_NO_THREADS
+    pthread_mutex_unlock(&cache_mutex);
+#endif
+}
+
+/*============================================================================*/
+
+obj *obj_create(const char *filename)
+{
+    obj *O;
+    int  i;
+
+    /* Allocate and initialize a new file. */
+
+    if ((O = (obj *) calloc(1, sizeof (obj))))
+    {
+        /* Set default shader locations. */
+
+        for (i = 0; i < OBJ_PROP_COUNT; i++)
+        {
+            O->cloc[i] = -1;
+            O->oloc[i] = -1;
+            O->Mloc[i] = -1;
+        }
+        O->uloc = -1;
+        O->nloc = -1;
+        O->tloc = -1;
+        O->vloc = -1;
+
+        /* Read the named file. */
+
+        if (filename)
+            obj_read(O, filename);
+    }
+    return O;
+}
+
+static int read_proc(obj *O, const char *filename, int defer,
+                     const struct cache_opt *K)
+{
+    struct cache_halt C;
+
+    char  full[MAXSTR];
+    char  path[MAXSTR];
+    char  key[MAXSTR + 128];
+    char *dep = NULL;
+    int   c;
+    int   r;
+
+    /* Take a current cache entry, or note the dependencies of a new one. */
+
+    if ((c = use_cache(O, K, filename, full, path, key)))
+    {
+        if (read_cache(O, path, key, defer))
+            return 1;
+
+        dep      = set_name(NULL, key);
+        filename = full;
+        C.fn     = O->pfn;
+        C.data   = O->pdata;
+        C.halt   = 0;
+
+        if (O->pfn)
+        {
+            O->pfn   = cache_progress;
+            O->pdata = &C;
+        }
+    }
+
+    /* Read the named file. */
+
+    r = read_obj(O, filename, defer, &dep);
+
+    /* Post-process the loaded object, unless the read was cancelled. */
+
+    obj_mini(O);
+
+    if (r >= 0)
+    {
+        obj_proc(O);
+
+        if (c && K->eps >= 0) obj_uniq(O, K->eps, K->dot, 0);
+        if (c && K->qc  >  0) obj_sort(O, K->qc);
+    }
+
+    /* Cache the result of a complete read. */
+
+    if (c)
+    {
+        O->pfn   = C.fn;
+        O->pdata = C.data;
+
+        if (r > 0 && C.halt == 0 && dep)
+            write_cache(O, path, dep);
+
+        free(dep);
+    }
+    return (r < 0) ? 0 : r;
+}
+
+int obj_read(obj *O, const char *filename)
+{
+    struct cache_opt K;
+
+    assert(O);
+    assert(filename);
+
+    get_cache(&K);
+
+    return read_proc(O, filename, 0, &K);
+}
+
+/*----------------------------------------------------------------------------*/
+
+#ifndef CONF_NO_THREADS
+static void *read_task(void *data)
+{
+    obj             *O = (obj *) data;
+    struct obj_task *T = O->task;
+
+    int r = read_proc(O, T->filename, 1, &T->cache);
+
+    /* Signal completion to any waiting thread. */
+
+    pthread_mutex_lock(&T->mutex);
+    T->r    = r;
+    T->done = 1;
+    pthread_cond_broadcast(&T->cond);
+    pthread_mutex_unlock(&T->mutex);
+
+    return NULL;
+}
+#endif
+
+static void free_task(obj *O)
+{
+    struct obj_task *T;
+
+    /* Finish any asynchronous read and release its task. */
+
+    if ((T = O->task))
+    {
+        obj_wait(O);
+#ifndef CONF_NO_THREADS
+        pthread_mutex_destroy(&T->mutex);
+        pthread_cond_destroy (&T->cond);
+#endif
+        free(T->filename);
+        free(T);
+
+        O->task = NULL;
+    }
+}
+
+int obj_read_async(obj *O, const char *filename)
+{
+    struct obj_task *T;
+
+    assert(O);
+    assert(filename);
+
+    /* Finish any earlier read, then create a task to read into this file. */
+
+    free_task(O);
+
+    if ((T = (struct obj_task *) calloc(1, sizeof (struct obj_task))))
+    {
+        if ((T->filename = set_name(NULL, filename)))
+        {
+            O->task = T;
+
+            /* Fix the cache settings now, as the worker may start late. */
+
+            get_cache(&T->cache);
+#ifndef CONF_NO_THREADS
+            pthread_mutex_init(&T->mutex, NULL);
+            pthread_cond_init (&T->cond,  NULL);
+
+            /* Start the worker. */
+
+            if (pthread_create(&T->thread, NULL, read_task, O) == 0)
+            {
+                T->joinable = 1;
+                return 1;
+            }
+#endif
+            /* Lacking a worker, read the file here, still without GL. */
+
+            T->r    = read_proc(O, filename, 1, &T->cache);
+            T->done = 1;
+
+            return 1;
+        }
+        free(T);
+    }
+    return 0;
+}
+
+obj *obj_create_async(const char *filename)
+{
+    obj *O;
+
+    assert(filename);
+
+    /* Create an empty file and start a read into it. */
+
+    if ((O = obj_create(NULL)))
+    {
+        if (obj_read_async(O, filename))
+            return O;
+
+        obj_delete(O);
+    }
+    return NULL;
+}
+
+int obj_poll(obj *O)
+{
+    struct obj_task *T;
+
+    int d = 1;
+
+    assert(O);
+
+    /* Check whether an asynchronous read has completed. */
+
+    if ((T = O->task))
+    {
+#ifndef CONF_NO_THREADS
+        pthread_mutex_lock(&T->mutex);
+        d = T->done;
+        pthread_mutex_unlock(&T->mutex);
+#else
+        d = T->done;
+#endif
+    }
+    return d;
+}
+
+int obj_wait(obj *O)
+{
+    struct obj_task *T;
+
+    assert(O);
+
+    /* Block until an asynchronous read completes, and return its result. */
+
+    if ((T = O->task))
+    {
+#ifndef CONF_NO_THREADS
+        int j;
+
+        /* Claim the join under the lock, so only one waiter joins. */
+
+        pthread_mutex_lock(&T->mutex);
+        while (T->done == 0)
+            pthread_cond_wait(&T->cond, &T->mutex);
+
+        j           = T->joinable;
+        T->joinable = 0;
+        pthread_mutex_unlock(&T->mutex);
+
+        if (j)
+            pthread_join(T->thread, NULL);
+#endif
+        return T->r;
+    }
+    return 1;
+}
+
+/*----------------------------------------------------------------------------*/
+
+obj_load *obj_load_begin(obj *O, obj_resolver res, void *data)
+{
+    obj_load *L;
+
+    assert(O);
+
+    /* Begin an incremental load, resolving names relative to here. */
+
+    if ((L = (obj_load *) malloc(sizeof (obj_load))))
+    {
+        if (init_load(L, O) == 0)
+        {
+            free(L);
+            return NULL;
+        }
+
+        strcpy(L->dir, ".");
+
+        L->res      = res;
+        L->res_data = data;
+    }
+    return L;
+}
+
+static int feed_carry(obj_load *L, const char *c, const char *e)
+{
+    size_t n = (size_t) (e - c);
+    size_t m = L->bm;
+    char  *p;
+
+    /* Append the given bytes to the partial line buffer. */
+
+    if (L->bc + n > m)
+    {
+        while (L->bc + n > m)
+            m = (m > 0) ? m * 2 : MAXSTR;
+
+        if ((p = (char *) realloc(L->buf, m)) == NULL)
+            return 0;
+
+        L->buf = p;
+        L->bm  = m;
+    }
+    memcpy(L->buf + L->bc, c, n);
+    L->bc += n;
+
+    return 1;
+}
+
+int obj_load_feed(obj_load *L, const void *buf, size_t len)
+{
+    const char *c = (const char *) buf;
+    const char *e = (const char *) buf + len;
+    const char *d;
+
+    read_func func;
+
+    assert(L);
+
+    /* Ignore all data following a cancellation. */
+
+    if (L->halt)
+        return 0;
+
+    func = L->O->pfn ? read_line_step : read_line;
+
+    /* Complete any partial line carried over from the previous feed. */
+
+    if (L->bc > 0)
+    {
+        if ((d = (const char *) memchr(c, '\n', len)) == NULL)
+            return feed_carry(L, c, e);
+
+        if (!feed_carry(L, c, d + 1))
+            return 0;
+
+        if (read_lines(func, L, L->buf, L->buf + L->bc) == NULL)
+            return 0;
+
+        L->bc = 0;
+        c     = d + 1;
+    }
+
+    /* Process all complete lines in place and carry the remainder. */
+
+    if ((d = read_lines(func, L, c, e)) == NULL)
+        return 0;
+
+    if (d < e)
+        return feed_carry(L, d, e);
+
+    return 1;
+}
+
+void obj_load_end(obj_load *L)
+{
+    obj *O;
+    int  h;
+
+    if (L)
+    {
+        O = L->O;
+
+        /* Process any unterminated final line and release the load. */
+
+        if ((h = L->halt) == 0)
+            read_last(read_line, L, L->buf, L->buf + L->bc);
+
+        free_load(L);
+        free(L->buf);
+        free(L);
+
+        /* Post-process the loaded object, unless the load was cancelled. */
+
+        obj_mini(O);
+
+        if (h == 0)
+            obj_proc(O);
+    }
+}
+
+int obj_probe(const char *filename, struct obj_info *I,
+              obj_reporter fn, void *data)
+{
+    struct probe P;
+
+    assert(filename);
+    assert(I);
+
+    memset(I, 0, sizeof (struct obj_info));
+
+    /* Scan the named file relative to its own directory. */
+
+    P.I    = I;
+    P.fn   = fn;
+    P.data = data;
+
+    strncpy(P.dir, filename, MAXSTR - 1);
+    P.dir[MAXSTR - 1] = 0;
+    dirpath(P.dir);
+
+    return read_file(filename, 0, probe_line, &P);
+}
+
+void obj_delete(obj *O)
+{
+    assert(O);
+
+    /* Finish any asynchronous read before releasing its target. */
+
+    free_task(O);
+    obj_rel(O);
+
+    free(O);
+}
+
+/*----------------------------------------------------------------------------*/
+
+int obj_add_mtrl(obj *O)
+{
+    unsigned int opt = 0;
+
+    const float Kd[4] = { 0.8f, 0.8f, 0.8f, 1.0f };
+    const float Ka[4] = { 0.2f, 0.2f, 0.2f, 1.0f };
+    const float Ke[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+    const float Ks[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+    const float Ns[4] = { 8.0f, 0.0f, 0.0f, 0.0f };
+    const float  s[3] = { 1.0f, 1.0f, 1.0f       };
+
+    int mi;
+
+    assert(O);
+
+    /* Allocate and initialize a new material. */
+
+    if ((mi = add__((void **) &O->mv,
+                              &O->mc,
+                              &O->mm, sizeof (struct obj_mtrl))) >= 0)
+    {
+        memset(O->mv + mi, 0, sizeof (struct obj_mtrl));
+
+        obj_set_mtrl_opt(O, mi, OBJ_KD, opt);
+        obj_set_mtrl_opt(O, mi, OBJ_KA, opt);
+        obj_set_mtrl_opt(O, mi, OBJ_KE, opt);
+        obj_set_mtrl_opt(O, mi, OBJ_KS, opt);
+        obj_set_mtrl_opt(O, mi, OBJ_NS, opt);
+        obj_set_mtrl_opt(O, mi, OBJ_KN, opt);
+
+        obj_set_mtrl_c  (O, mi, OBJ_KD, Kd);
+        obj_set_mtrl_c  (O, mi, OBJ_KA, Ka);
+        obj_set_mtrl_c  (O, mi, OBJ_KE, Ke);
+        obj_set_mtrl_c  (O, mi, OBJ_KS, Ks);
+        obj_set_mtrl_c  (O, mi, OBJ_NS, Ns);
+
+        obj_set_mtrl_s  (O, mi, OBJ_KD, s);
+        obj_set_mtrl_s  (O, mi, OBJ_KA, s);
+        obj_set_mtrl_s  (O, mi, OBJ_KE, s);
+        obj_set_mtrl_s  (O, mi, OBJ_KS, s);
+        obj_set_mtrl_s  (O, mi, OBJ_NS, s);
+        obj_set_mtrl_s  (O, mi, OBJ_KN, s);
+    }
+    return mi;
+}
+
+int obj_add_vert(obj *O)
+{
+    int vi;
+
+    assert(O);
+
+    /* Allocate and initialize a new vertex. */
+
+    if (own_map(O) == 0)
+        return -1;
+
+    if (O->vc == O->vm && !reserve_vert(O, (O->vm > 0) ? O->vm * 2 : 2))
+        return -1;
+
+    vi = O->vc++;
+
+    memset(O->uv[vi], 0, sizeof (*O->uv));
+    memset(O->nv[vi], 0, sizeof (*O->nv));
+    memset(O->tv[vi], 0, sizeof (*O->tv));
+    memset(O->vv[vi], 0, sizeof (*O->vv));
+
+    return vi;
+}
+
+int obj_add_poly(obj *O, int si)
+{
+    int pi;
+
+    assert_surf(O, si);
+
+    /* Allocate and initialize a new polygon. */
+
+    if (own_map(O) == 0)
+        return -1;
+
+    if ((pi = add__((void **) &O->sv[si].pv,
+                              &O->sv[si].pc,
+                              &O->sv[si].pm, sizeof (struct obj_poly)))>=0)
+
+        memset(O->sv[si].pv + pi, 0, sizeof (struct obj_poly));
+
+    return pi;
+}
+
+int obj_add_line(obj *O, int si)
+{
+    int li;
+
+    assert_surf(O, si);
+
+    /* Allocate and initialize a new line. */
+
+    if (own_map(O) == 0)
+        return -1;
+
+    if ((li = add__((void **) &O->sv[si].lv,
+                              &O->sv[si].lc,
+                              &O->sv[si].lm, sizeof (struct obj_line)))>=0)
+
+        memset(O->sv[si].lv + li, 0, sizeof (struct obj_line));
+
+    return li;
+}
+
+int obj_add_surf(obj *O)
+{
+    int si;
+
+    assert(O);
+
+    /* Allocate and initialize a new surface. */
+
+    if ((si = add__((void **) &O->sv,
+                              &O->sc,
+                              &O->sm, sizeof (struct obj_surf))) >= 0)
+
+        memset(O->sv + si, 0, sizeof (struct obj_surf));
+
+    return si;
+}
+
+/*----------------------------------------------------------------------------*/
+
+int obj_num_mtrl(const obj *O)
+{
+    assert(O);
+    return O->mc;
+}
+
+int obj_num_vert(const obj *O)
+{
+    assert(O);
+    return O->vc;
+}
+
+int obj_num_poly(const obj *O, int si)
+{
+    assert_surf(O, si);
+    return O->sv[si].pc;
+}
+
+int obj_num_line(const obj *O, int si)
+{
+    assert_surf(O, si);
+    return O->sv[si].lc;
+}
+
+int obj_num_surf(const obj *O)
+{
+    assert(O);
+    return O->sc;
+}
+
+
+/*----------------------------------------------------------------------------*/
+
+void obj_del_mtrl(obj *O, int mi)
+{
+    int si;
+
+    assert_mtrl(O, mi);
+
+    /* Remove this material from the material vector. */
+
+    obj_rel_mtrl(O->mv + mi);
+
+    memmove(O->mv + mi,
+            O->mv + mi + 1,
+           (O->mc - mi - 1) * sizeof (struct obj_mtrl));
+
+    O->mc--;
+
+    /* Remove all references to this material. */
+
+    for (si = O->sc - 1; si >= 0; --si)
+    {
+        struct obj_surf *sp = O->sv + si;
+
+        if (sp->mi == mi)
+            obj_del_surf(O, si);
+        else
+            if (sp->mi > mi)
+                sp->mi--;
+    }
+}
+
+void obj_del_vert(obj *O, int vi)
+{
+    size_t s;
+    char  *p;
+    int    si;
+    int    pi;
+    int    li;
+    int    k;
+
+    assert_vert(O, vi);
+
+    /* Remove this vertex from each of the file's vertex arrays. */
+
+    for (k = 0; k < VERT_ARRAYS; ++k)
+    {
+        p = (char *) *vert_array(O, k, &s);
+
+        memmove(p + s * vi, p + s * (vi + 1), s * (O->vc - vi - 1));
+    }
+
+    O->vc--;
+
+    /* Remove all references to this vertex from all surfaces. */
+
+    for (si = 0; si < O->sc; ++si)
+    {
+        /* Delete all referencing polygons. Decrement later references. */
+
+        for (pi = O->sv[si].pc - 1; pi >= 0; --pi)
+        {
+            struct obj_poly *pp = O->sv[si].pv + pi;
+
+            if (pp->vi[0] == vi || pp->vi[1] == vi || pp->vi[2] == vi)
+                obj_del_poly(O, si, pi);
+            else
+            {
+                if (pp->vi[0] > vi) pp->vi[0]--;
+                if (pp->vi[1] > vi) pp->vi[1]--;
+                if (pp->vi[2] > vi) pp->vi[2]--;
+            }
+        }
+
+        /* Delete all referencing lines. Decrement later references. */
+
+        for (li = O->sv[si].lc - 1; li >= 0; --li)
+        {
+            struct obj_line *lp = O->sv[si].lv + li;
+
+            if (lp->vi[0] == vi || lp->vi[1] == vi)
+                obj_del_line(O, si, li);
+            else
+            {
+                if (lp->vi[0] > vi) lp->vi[0]--;
+                if (lp->vi[1] > vi) lp->vi[1]--;
+            }
+        }
+    }
+
+    /* Schedule the VBO for refresh. */
+
+    invalidate(O);
+}
+
+void obj_del_poly(obj *O, int si, int pi)
+{
+    assert_poly(O, si, pi);
+
+    /* Remove this polygon from the surface's polygon vector. */
+
+    memmove(O->sv[si].pv + pi,
+            O->sv[si].pv + pi + 1,
+           (O->sv[si].pc - pi - 1) * sizeof (struct obj_poly));
+
+    O->sv[si].pc--;
+}
+
+void obj_del_line(obj *O, int si, int li)
+{
+    assert_line(O, si, li);
+
+    /* Remove this line from the surface's line vector. */
+
+    memmove(O->sv[si].lv + li,
+            O->sv[si].lv + li + 1,
+           (O->sv[si].lc - li - 1) * sizeof (struct obj_line));
+
+    O->sv[si].lc--;
+}
+
+void obj_del_surf(obj *O, int si)
+{
+    assert_surf(O, si);
+
+    /* Remove this surface from the file's surface vector. Mapped arrays */
+    /* are released with the map.                                        */
+
+    if (in_map(O, O->sv[si].pv)) O->sv[si].pv = NULL;
+    if (in_map(O, O->sv[si].lv)) O->sv[si].lv = NULL;
+
+    obj_rel_surf(O->sv + si);
+
+    memmove(O->sv + si,
+            O->sv + si + 1,
+           (O->sc - si - 1) * sizeof (struct obj_surf));
+
+    O->sc--;
+}
+
+/*----------------------------------------------------------------------------*/
+
+static char *set_name(char *old, const char *src)
+{
+    char *dst = NULL;
+
+    if (old)
+        free(old);
+
+    if (src && (dst = (char *) malloc(strlen(src) + 1)))
+        strcpy(dst, src);
+
+    return dst;
+}
+
+void obj_set_mtrl_name(obj *O, int mi, const char *name)
+{
+    assert_mtrl(O, mi);
+    O->mv[mi].name = set_name(O->mv[mi].name, name);
+}
+
+void obj_set_mtrl_map(obj *O, int mi, int ki, const char *str)
+{
+    assert_prop(O, mi, ki);
+    set_map(O, mi, ki, str, get_image(str));
+    bind_map(O, mi, ki);
+}
+
+void obj_set_mtrl_opt(obj *O, int mi, int ki, unsigned int opt)
+{
+    assert_prop(O, mi, ki);
+
+    O->mv[mi].kv[ki].opt = opt;
+}
+
+void obj_set_mtrl_c(obj *O, int mi, int ki, const float c[4])
+{
+    assert_prop(O, mi, ki);
+
+    O->mv[mi].kv[ki].c[0] = c[0];
+    O->mv[mi].kv[ki].c[1] = c[1];
+    O->mv[mi].kv[ki].c[2] = c[2];
+    O->mv[mi].kv[ki].c[3] = c[3];
+}
+
+void obj_set_mtrl_s(obj *O, int mi, int ki, const float s[3])
+{
+    assert_prop(O, mi, ki);
+
+    O->mv[mi].kv[ki].s[0] = s[0];
+    O->mv[mi].kv[ki].s[1] = s[1];
+    O->mv[mi].kv[ki].s[2] = s[2];
+}
+
+void obj_set_mtrl_o(obj *O, int mi, int ki, const float o[3])
+{
+    assert_prop(O, mi, ki);
+
+    O->mv[mi].kv[ki].o[0] = o[0];
+    O->mv[mi].kv[ki].o[1] = o[1];
+    O->mv[mi].kv[ki].o[2] = o[2];
+}
+
+/*----------------------------------------------------------------------------*/
+
+static void invalidate(obj *O)
+{
+#ifndef CONF_NO_GL
+    if (O->vbo) glDeleteBuffers     (1, &O->vbo);
+    if (O->vao) glDeleteVertexArrays(1, &O->vao);
+#endif
+    O->vbo = 0;
+    O->vao = 0;
+}
+
+void obj_set_vert_v(obj *O, int vi, const float v[3])
+{
+    assert_vert(O, vi);
+
+    O->vv[vi][0] = v[0];
+    O->vv[vi][1] = v[1];
+    O->vv[vi][2] = v[2];
+
+    invalidate(O);
+}
+
+void obj_set_vert_t(obj *O, int vi, const float t[2])
+{
+    assert_vert(O, vi);
+
+    O->tv[vi][0] = t[0];
+    O->tv[vi][1] = t[1];
+
+    invalidate(O);
+}
+
+void obj_set_vert_n(obj *O, int vi, const float n[3])
+{
+    assert_vert(O, vi);
+
+    O->nv[vi][0] = n[0];
+    O->nv[vi][1] = n[1];
+    O->nv[vi][2] = n[2];
+
+    invalidate(O);
+}
+
+void obj_set_vert_u(obj *O, int vi, const float u[3])
+{
+    assert_vert(O, vi);
+
+    O->uv[vi][0] = u[0];
+    O->uv[vi][1] = u[1];
+    O->uv[vi][2] = u[2];
+
+    invalidate(O);
+}
+
+/*----------------------------------------------------------------------------*/
+
+void obj_set_poly(obj *O, int si, int pi, const int vi[3])
+{
+    assert_poly(O, si, pi);
+
+    O->sv[si].pv[pi].vi[0] = (index_t) vi[0];
+    O->sv[si].pv[pi].vi[1] = (index_t) vi[1];
+    O->sv[si].pv[pi].vi[2] = (index_t) vi[2];
+}
+
+void obj_set_line(obj *O, int si, int li, const int vi[2])
+{
+    assert_line(O, si, li);
+
+    O->sv[si].lv[li].vi[0] = (index_t) vi[0];
+    O->sv[si].lv[li].vi[1] = (index_t) vi[1];
+}
+
+void obj_set_surf(obj *O, int si, int mi)
+{
+    assert_surf(O, si);
+
+    O->sv[si].mi = mi;
+}
+
+/*----------------------------------------------------------------------------*/
+
+void obj_set_vert_loc(obj *O, int u, int n, int t, int v)
+{
+    assert(O);
+
+    O->uloc = u;
+    O->nloc = n;
+    O->tloc = t;
+    O->vloc = v;
+
+    invalidate(O);
+}
+
+void obj_set_prop_loc(obj *O, int ki, int c, int o, int M)
+{
+    assert(O);
+    assert(0 <= ki && ki < OBJ_PROP_COUNT);
+
+    O->cloc[ki] = c;
+    O->oloc[ki] = o;
+    O->Mloc[ki] = M;
+}
+
+void obj_set_read_opt(obj *O, unsigned int opt)
+{
+    assert(O);
+
+    O->ropt = opt;
+}
+
+void obj_set_write_opt(obj *O, unsigned int opt)
+{
+    assert(O);
+
+    O->wopt = opt;
+}
+
+void obj_set_vert_fmt(obj *O, unsigned int fmt)
+{
+    assert(O);
+
+    O->vfmt = fmt;
+
+    invalidate(O);
+}
+
+void obj_set_threads(obj *O, int n)
+{
+    assert(O);
+
+    O->threads = n;
+}
+
+void obj_set_progress(obj *O, obj_progress fn, void *data)
+{
+    assert(O);
+
+    O->pfn   = fn;
+    O->pdata = data;
+}
+
+void obj_set_select(obj *O, obj_selector fn, void *data)
+{
+    assert(O);
+
+    O->sfn   = fn;
+    O->sdata = data;
+}
+
+/*============================================================================*/
+
+const char *obj_get_mtrl_name(const obj *O, int mi)
+{
+    assert_mtrl(O, mi);
+    return O->mv[mi].name;
+}
+
+unsigned int obj_get_mtrl_map(const obj *O, int mi, int ki)
+{
+    assert_prop(O, mi, ki);
+    return O->mv[mi].kv[ki].map;
+}
+
+unsigned int obj_get_mtrl_opt(const obj *O, int mi, int ki)
+{
+    assert_prop(O, mi, ki);
+    return O->mv[mi].kv[ki].opt;
+}
+
+void obj_get_mtrl_c(const obj *O, int mi, int ki, float *c)
+{
+    assert_prop(O, mi, ki);
+
+    c[0] = O->mv[mi].kv[ki].c[0];
+    c[1] = O->mv[mi].kv[ki].c[1];
+    c[2] = O->mv[mi].kv[ki].c[2];
+    c[3] = O->mv[mi].kv[ki].c[3];
+}
+
+void obj_get_mtrl_s(const obj *O, int mi, int ki, float *s)
+{
+    assert_prop(O, mi, ki);
+
+    s[0] = O->mv[mi].kv[ki].s[0];
+    s[1] = O->mv[mi].kv[ki].s[1];
+    s[2] = O->mv[mi].kv[ki].s[2];
+}
+
+void obj_get_mtrl_o(const obj *O, int mi, int ki, float *o)
+{
+    assert_prop(O, mi, ki);
+
+    o[0] = O->mv[mi].kv[ki].o[0];
+    o[1] = O->mv[mi].kv[ki].o[1];
+    o[2] = O->mv[mi].kv[ki].o[2];
+}
+
+/*----------------------------------------------------------------------------*/
+
+void obj_get_vert_v(const obj *O, int vi, float *v)
+{
+    assert_vert(O, vi);
+
+    v[0] = O->vv[vi][0];
+    v[1] = O->vv[vi][1];
+    v[2] = O->vv[vi][2];
+}
+
+void obj_get_vert_t(const obj *O, int vi, float *t)
+{
+    assert_vert(O, vi);
+
+    t[0] = O->tv[vi][0];
+    t[1] = O->tv[vi][1];
+}
+
+void obj_get_vert_n(const obj *O, int vi, float *n)
+{
+    assert_vert(O, vi);
+
+    n[0] = O->nv[vi][0];
+    n[1] = O->nv[vi][1];
+    n[2] = O->nv[vi][2];
+}
+
+/*----------------------------------------------------------------------------*/
+
+void obj_get_poly(const obj *O, int si, int pi, int *vi)
+{
+    assert_poly(O, si, pi);
+
+    vi[0] = (int) O->sv[si].pv[pi].vi[0];
+    vi[1] = (int) O->sv[si].pv[pi].vi[1];
+    vi[2] = (int) O->sv[si].pv[pi].vi[2];
+}
+
+void obj_get_line(const obj *O, int si, int li, int *vi)
+{
+    assert_line(O, si, li);
+
+    vi[0] = (int) O->sv[si].lv[li].vi[0];
+    vi[1] = (int) O->sv[si].lv[li].vi[1];
+}
+
+int obj_get_surf(const obj *O, int si)
+{
+    assert_surf(O, si);
+    return O->sv[si].mi;
+}
+
+/*============================================================================*/
+
+void obj_mini(obj *O)
+{
+    int si;
+    int mi;
+
+    /* Remove empty surfaces. */
+
+    for (si = O->sc - 1; si >= 0; --si)
+        if (O->sv[si].pc == 0 &&
+            O->sv[si].lc == 0)
+            obj_del_surf(O, si);
+
+    /* Remove unreferenced materials. */
+
+    for (mi = O->mc - 1; mi >= 0; --mi)
+    {
+        int cc = 0;
+
+        for (si = 0; si < O->sc; ++si)
+            if (O->sv[si].mi == mi)
+                cc++;
+
+        if (cc == 0)
+            obj_del_mtrl(O, mi);
+    }
+}
+
+void obj_norm(obj *O)
+{
+    size_t pn = num_polys(O);
+    size_t pk = 0;
+
+    int si;
+    int pi;
+
+    assert(O);
+
+    /* Zero the normals for all vertices. */
+
+    if (O->vc > 0)
+        memset(O->nv, 0, O->vc * sizeof (*O->nv));
+
+    /* Compute normals for all faces. */
+
+    for (si = 0; si < O->sc; ++si)
+        for (pi = 0; pi < O->sv[si].pc; ++pi)
+        {
+            const index_t *i = O->sv[si].pv[pi].vi;
+
+            float *n0 = O->nv[i[0]];
+            float *n1 = O->nv[i[1]];
+            float *n2 = O->nv[i[2]];
+
+            float n[3];
+
+            if (++pk % MAXSTEP == 0 && report(O, OBJ_PROG_NORM, pk, pn))
+                return;
+
+            /* Compute the normal formed by these 3 vertices. */
+
+            normal(n, O->vv[i[0]], O->vv[i[1]], O->vv[i[2]]);
+
+            /* Sum this normal to all vertices. */
+
+            n0[0] += n[0];
+            n0[1] += n[1];
+            n0[2] += n[2];
+
+            n1[0] += n[0];
+            n1[1] += n[1];
+            n1[2] += n[2];
+
+            n2[0] += n[0];
+            n2[1] += n[1];
+            n2[2] += n[2];
+        }
+}
+
+void obj_proc(obj *O)
+{
+    size_t pn = num_polys(O);
+    size_t pk = 0;
+
+    int si;
+    int sj;
+    int pi;
+    int vi;
+
+    assert(O);
+
+    /* Normalize all normals. Zero all tangent vectors. */
+
+    for (vi = 0; vi < O->vc; ++vi)
+        normalize(O->nv[vi]);
+
+    if (O->vc > 0)
+        memset(O->uv, 0, O->vc * sizeof (*O->uv));
+
+    /* Compute tangent vectors for all vertices. */
+
+    for (si = 0; si < O->sc; ++si)
+        for (pi = 0; pi < O->sv[si].pc; ++pi)
+        {
+            const index_t *i = O->sv[si].pv[pi].vi;
+
+            const float *v0 = O->vv[i[0]];
+            const float *v1 = O->vv[i[1]];
+            const float *v2 = O->vv[i[2]];
+
+            float *u0 = O->uv[i[0]];
+            float *u1 = O->uv[i[1]];
+            float *u2 = O->uv[i[2]];
+
+            float dt1, dv1[3];
+            float dt2, dv2[3];
+
+            float u[3];
+
+            if (++pk % MAXSTEP == 0 && report(O, OBJ_PROG_PROC, pk, pn))
+                return;
+
+            /* Compute the tangent vector for this polygon. */
+
+            dv1[0] = v1[0] - v0[0];
+            dv1[1] = v1[1] - v0[1];
+            dv1[2] = v1[2] - v0[2];
+
+            dv2[0] = v2[0] - v0[0];
+            dv2[1] = v2[1] - v0[1];
+            dv2[2] = v2[2] - v0[2];
+
+            dt1    = O->tv[i[1]][1] - O->tv[i[0]][1];
+            dt2    = O->tv[i[2]][1] - O->tv[i[0]][1];
+
+            u[0]   = dt2 * dv1[0] - dt1 * dv2[0];
+            u[1]   = dt2 * dv1[1] - dt1 * dv2[1];
+            u[2]   = dt2 * dv1[2] - dt1 * dv2[2];
+
+            normalize(u);
+
+            /* Accumulate the tangent vectors for this polygon's vertices. */
+
+            u0[0] += u[0];  u0[1] += u[1];  u0[2] += u[2];
+            u1[0] += u[0];  u1[1] += u[1];  u1[2] += u[2];
+            u2[0] += u[0];  u2[1] += u[1];  u2[2] += u[2];
+        }
+
+    /* Orthonormalize each tangent basis. */
+
+    for (vi = 0; vi < O->vc; ++vi)
+    {
+        float *n = O->nv[vi];
+        float *u = O->uv[vi];
+
+        float v[3];
+
+        cross(v, n, u);
+        cross(u, v, n);
+        normalize(u);
+    }
+
+    /* Sort surfaces such that transparent ones appear later. */
+
+    for (si = 0; si < O->sc; ++si)
+        for (sj = si + 1; sj < O->sc; ++sj)
+            if (O->mv[O->sv[si].mi].kv[OBJ_KD].c[3] <
+                O->mv[O->sv[sj].mi].kv[OBJ_KD].c[3])
+            {
+                struct obj_surf temp;
+
+                temp      = O->sv[si];
+                O->sv[si] = O->sv[sj];
+                O->sv[sj] = temp;
+            }
+}
+
+/*----------------------------------------------------------------------------*/
+
+/* Vertex attribute encodings selected by the vertex format options. */
+
+enum { VERT_FLOAT, VERT_HALF, VERT_SNORM10, VERT_UNORM16 };
+
+struct vert_attr
+{
+    int    loc;                 /* Shader location, or -1 if dropped    */
+    int    k;                   /* Components in the source array       */
+    int    e;                   /* Encoding                             */
+    size_t o;                   /* Offset within the packed vertex      */
+};
+
+static unsigned int half_enc(float f)
+{
+    uint32_t b;
+    uint32_t s;
+    uint32_t m;
+    uint32_t h;
+    uint32_t r;
+    int      e;
+    int      n;
+
+    memcpy(&b, &f, sizeof (uint32_t));
+
+    s = (b >> 16) & 0x8000;
+    e = (b >> 23) & 0xFF;
+    m = (b & 0x7FFFFF);
+
+    /* Infinity and NaN keep their class. Overflow becomes infinity. */
+
+    if (e == 0xFF) return s | 0x7C00 | (m ? 0x200 : 0);
+    if (e >  142)  return s | 0x7C00;
+    if (e <  102)  return s;
+
+    /* Normals keep 10 bits of significand and subnormals fewer. Round to  */
+    /* nearest even. A carry out of the significand bumps the exponent.    */
+
+    if (e >= 113)
+    {
+        n = 13;
+        m = ((uint32_t) (e - 112) << 23) | m;
+    }
+    else
+    {
+        n = 126 - e;
+        m = m | 0x800000;
+    }
+
+    h = m >> n;
+    r = m & ((1u << n) - 1);
+
+    if (r > (1u << (n - 1)) || (r == (1u << (n - 1)) && (h & 1)))
+        h++;
+
+    return s | h;
+}
+
+static uint32_t snorm10(float f)
+{
+    if (f != f) f =  0;
+    if (f < -1) f = -1;
+    if (f > +1) f = +1;
+
+    return (uint32_t) (int) floor(f * 511.0f + 0.5f) & 0x3FF;
+}
+
+static unsigned int unorm16(float f)
+{
+    if (f != f) f = 0;
+    if (f <  0) f = 0;
+    if (f >  1) f = 1;
+
+    return (unsigned int) floor(f * 65535.0f + 0.5f);
+}
+
+static size_t vert_layout(const obj *O, struct vert_attr *A)
+{
+    const int loc[VERT_ARRAYS] = { O->uloc, O->nloc, O->tloc, O->vloc };
+
+    size_t s = 0;
+    int    k;
+
+    /* Choose each attribute's encoding and its offset in the vertex. */
+
+    for (k = 0; k < VERT_ARRAYS; ++k)
+    {
+        A[k].loc = loc[k];
+        A[k].k   = (k == 2) ? 2 : 3;
+        A[k].e   = VERT_FLOAT;
+        A[k].o   = s;
+
+        if (k < 2 && (O->vfmt & OBJ_VERT_SNORM_N))
+            A[k].e = VERT_SNORM10;
+        if (k == 2 && (O->vfmt & OBJ_VERT_HALF_T))
+            A[k].e = VERT_HALF;
+        if (k == 2 && (O->vfmt & OBJ_VERT_UNORM_T))
+            A[k].e = VERT_UNORM16;
+        if (k == 3 && (O->vfmt & OBJ_VERT_HALF_V))
+            A[k].e = VERT_HALF;
+
+        /* Attributes without a shader location are not uploaded. Others */
+        /* are padded to four bytes.                                     */
+
+        if (A[k].loc >= 0)
+        {
+            if (A[k].e == VERT_FLOAT)   s += 4 * A[k].k;
+            if (A[k].e == VERT_SNORM10) s += 4;
+            if (A[k].e != VERT_FLOAT &&
+                A[k].e != VERT_SNORM10) s += (2 * A[k].k + 3) & ~3;
+        }
+    }
+    return s;
+}
+
+static void vert_pack(const obj *O, const struct vert_attr *A,
+                      int vi, unsigned char *p)
+{
+    const float *a[VERT_ARRAYS];
+
+    unsigned short h[4];
+    uint32_t w;
+    int k;
+    int i;
+
+    a[0] = O->uv[vi];
+    a[1] = O->nv[vi];
+    a[2] = O->tv[vi];
+    a[3] = O->vv[vi];
+
+    /* Encode each uploaded attribute of vertex vi at its offset. */
+
+    for (k = 0; k < VERT_ARRAYS; ++k)
+        if (A[k].loc >= 0)
+            switch (A[k].e)
+            {
+            case VERT_FLOAT:
+                memcpy(p + A[k].o, a[k], 4 * A[k].k);
+                break;
+
+            case VERT_SNORM10:
+                w = snorm10(a[k][0])
+                  | snorm10(a[k][1]) << 10
+                  | snorm10(a[k][2]) << 20;
+                memcpy(p + A[k].o, &w, 4);
+                break;
+
+            default:
+                for (i = 0; i < 4; ++i)
+                    h[i] = 0;
+                for (i = 0; i < A[k].k; ++i)
+                    h[i] = (A[k].e == VERT_HALF) ? half_enc(a[k][i])
+                                                 : unorm16 (a[k][i]);
+                memcpy(p + A[k].o, h, (2 * A[k].k + 3) & ~3);
+                break;
+            }
+}
+
+size_t obj_pack_vert(const obj *O, void *p)
+{
+    struct vert_attr A[VERT_ARRAYS];
+
+    size_t s;
+    int    vi;
+
+    assert(O);
+
+    /* Pack every vertex in the selected format, or only give its size. */
+
+    s = vert_layout(O, A);
+
+    if (p)
+        for (vi = 0; vi < O->vc; ++vi)
+            vert_pack(O, A, vi, (unsigned char *) p + vi * s);
+
+    return s;
+}
+
+#ifndef CONF_NO_GL
+
+static const GLenum vert_type[] = {
+    GL_FLOAT,
+    GL_HALF_FLOAT,
+    GL_INT_2_10_10_10_REV,
+    GL_UNSIGNED_SHORT
+};
+
+/* Elements that span fewer than 65535 vertices are uploaded as 16-bit      */
+/* offsets from the lowest vertex they use, which is drawn as the base      */
+/* vertex. The offset 0xFFFF is avoided as it may be a restart index.       */
+
+static int surf_base(const struct obj_surf *sp)
+{
+    index_t lo = (index_t) -1;
+    index_t hi = 0;
+
+    int pi;
+    int li;
+    int i;
+
+    for (pi = 0; pi < sp->pc; ++pi)
+        for (i = 0; i < 3; ++i)
+        {
+            if (lo > sp->pv[pi].vi[i]) lo = sp->pv[pi].vi[i];
+            if (hi < sp->pv[pi].vi[i]) hi = sp->pv[pi].vi[i];
+        }
+    for (li = 0; li < sp->lc; ++li)
+        for (i = 0; i < 2; ++i)
+        {
+            if (lo > sp->lv[li].vi[i]) lo = sp->lv[li].vi[i];
+            if (hi < sp->lv[li].vi[i]) hi = sp->lv[li].vi[i];
+        }
+
+    if (lo <= hi && hi - lo < 0xFFFF && lo <= (index_t) INT_MAX)
+        return (int) lo;
+    else
+        return -1;
+}
+
+static void elem_data(const index_t *v, size_t n, int base, unsigned short *w)
+{
+    size_t i;
+
+    /* Upload n indices at full width, or as 16-bit offsets from base. */
+
+    if (base < 0)
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, n * sizeof (index_t),
+                                              v, GL_STATIC_DRAW);
+    else
+    {
+        for (i = 0; i < n; ++i)
+            w[i] = (unsigned short) (v[i] - (index_t) base);
+
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, n * sizeof (unsigned short),
+                                              w, GL_STATIC_DRAW);
+    }
+}
+
+#endif
+
+/*----------------------------------------------------------------------------*/
+
+void obj_init(obj *O)
+{
+    int mi;
+    int ki;
+
+    assert(O);
+
+    /* Upload any material images deferred by an asynchronous read. */
+
+    for (mi = 0; mi < O->mc; ++mi)
+        for (ki = 0; ki < OBJ_PROP_COUNT; ++ki)
+            bind_map(O, mi, ki);
+
+#ifndef CONF_NO_GL
+    if (O->vao == 0)
+    {
+        struct vert_attr A[VERT_ARRAYS];
+        unsigned char   *vv;
+        size_t           vs;
+
+        int si;
+        int k;
+
+        /* Store the following bindings in a vertex array object. */
+
+        glGenVertexArrays(1, &O->vao);
+        glBindVertexArray(    O->vao);
+
+        /* Pack the vertex data in the selected format into a vertex      */
+        /* buffer object.                                                 */
+
+        glGenBuffers(1, &O->vbo);
+        glBindBuffer(GL_ARRAY_BUFFER, O->vbo);
+
+        vs = vert_layout(O, A);
+
+        if ((vv = (unsigned char *) malloc(O->vc * vs + 1)))
+        {
+            obj_pack_vert(O, vv);
+
+            glBufferData(GL_ARRAY_BUFFER, O->vc * vs, vv, GL_STATIC_DRAW);
+            free(vv);
+        }
+
+        /* Store all index data in index buffer objects, 16-bit where the */
+        /* surface allows.                                                 */
+
+        for (si = 0; si < O->sc; ++si)
+        {
+            struct obj_surf *sp = O->sv + si;
+            unsigned short  *w  = NULL;
+
+            size_t n = (3 * sp->pc > 2 * sp->lc) ? 3 * sp->pc : 2 * sp->lc;
+
+            if ((sp->ibase = surf_base(sp)) >= 0)
+                if ((w = (unsigned short *) malloc(n * sizeof (*w))) == NULL)
+                    sp->ibase = -1;
+
+            if (sp->pc > 0)
+            {
+                glGenBuffers(1, &sp->pibo);
+                glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sp->pibo);
+                elem_data(sp->pv->vi, 3 * sp->pc, sp->ibase, w);
+            }
+
+            if (sp->lc > 0)
+            {
+                glGenBuffers(1, &sp->libo);
+                glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sp->libo);
+                elem_data(sp->lv->vi, 2 * sp->lc, sp->ibase, w);
+            }
+
+            free(w);
+        }
+
+        /* Enable and bind the attributes. */
+
+        for (k = 0; k < VERT_ARRAYS; ++k)
+        {
+            const GLint     n = (A[k].e == VERT_SNORM10) ? 4 : A[k].k;
+            const GLboolean m = (A[k].e >= VERT_SNORM10) ? GL_TRUE : GL_FALSE;
+
+            if (A[k].loc >= 0)
+            {
+                glEnableVertexAttribArray(A[k].loc);
+                glVertexAttribPointer(A[k].loc, n, vert_type[A[k].e], m, vs,
+                                      (const GLvoid *) A[k].o);
+            }
+        }
+    }
+#endif
+}
+
+/*----------------------------------------------------------------------------*/
+
+int obj_cmp_vert(obj *O, int vi, int vj, float eps, float dot)
+{
+    if (fabs(O->vv[vi][0] - O->vv[vj][0]) >= eps) return 0;
+    if (fabs(O->vv[vi][1] - O->vv[vj][1]) >= eps) return 0;
+    if (fabs(O->vv[vi][2] - O->vv[vj][2]) >= eps) return 0;
+
+    if (fabs(O->tv[vi][0] - O->tv[vj][0]) >= eps) return 0;
+    if (fabs(O->tv[vi][1] - O->tv[vj][1]) >= eps) return 0;
+
+    if (O->nv[vi][0] * O->nv[vj][0] +
+        O->nv[vi][1] * O->nv[vj][1] +
+        O->nv[vi][2] * O->nv[vj][2] < dot) return 0;
+
+    return 1;
+}
+
+void obj_swp_vert(obj *O, int vi, int vj)
+{
+    int si;
+    int pi;
+    int li;
+
+    /* Replace all occurrences of vi with vj. */
+
+    for (si = 0; si < O->sc; ++si)
+    {
+        for (pi = 0; pi < O->sv[si].pc; ++pi)
+        {
+            if (O->sv[si].pv[pi].vi[0] == vi)
+                O->sv[si].pv[pi].vi[0] =  vj;
+            if (O->sv[si].pv[pi].vi[1] == vi)
+                O->sv[si].pv[pi].vi[1] =  vj;
+            if (O->sv[si].pv[pi].vi[2] == vi)
+                O->sv[si].pv[pi].vi[2] =  vj;
+        }
+        for (li = 0; li < O->sv[si].lc; ++li)
+        {
+            if (O->sv[si].lv[li].vi[0] == vi)
+                O->sv[si].lv[li].vi[0] =  vj;
+            if (O->sv[si].lv[li].vi[1] == vi)
+                O->sv[si].lv[li].vi[1] =  vj;
+        }
+    }
+}
+
+void obj_uniq(obj *O, float eps, float dot, int verbose)
+{
+    int vc = O->vc;
+    int vi;
+    int vj;
+    int di;
+
+    /* Merge all vertices within epsilon of one another. Each merge is    */
+    /* complete before progress is reported, so cancellation is safe.     */
+
+    for (vi = 0; vi < O->vc; vi += di)
+    {
+        if (report(O, OBJ_PROG_UNIQ, (size_t) vi, (size_t) O->vc))
+            break;
+
+        di = 1;
+
+        for (vj = 0; vj < vi; ++vj)
+        {
+            if (obj_cmp_vert(O, vi, vj, eps, dot))
+            {
+                if (verbose) printf("%d %d\n", vi, vc--);
+
+                obj_swp_vert(O, vi, vj);
+                obj_del_vert(O, vi);
+
+                di = 0;
+                break;
+            }
+        }
+    }
+}
+
+/*----------------------------------------------------------------------------*/
+
+void obj_sort(obj *O, int qc)
+{
+    const int vc = O->vc;
+
+    struct vert
+    {
+        int  qs;    /* Cache insertion serial number */
+        int *iv;    /* Polygon reference list buffer */
+        int  ic;    /* Polygon reference list length */
+    };
+
+    /* Vertex optimization data; vertex FIFO cache */
+
+    struct vert *vv = (struct vert *) malloc(vc * sizeof (struct vert));
+    int         *qv = (int         *) malloc(qc * sizeof (int        ));
+
+    int qs = 1;   /* Current cache insertion serial number */
+    int qi = 0;   /* Current cache insertion point [0, qc) */
+
+    size_t pt = num_polys(O);
+    size_t pd = 0;
+
+    int halt = 0;
+
+    int si;
+    int pi;
+    int vi;
+    int ii;
+    int qj;
+
+    /* Initialize the vertex cache to empty. */
+
+    for (qj = 0; qj < qc; ++qj)
+        qv[qj] = -1;
+
+    /* Process each surface of this file in turn. */
+
+    for (si = 0; si < O->sc && halt == 0; ++si)
+    {
+        const int pc = O->sv[si].pc;
+
+        /* Allocate the polygon reference list buffers. */
+
+        int *ip, *iv = (int *) malloc(3 * pc * sizeof (int));
+
+        /* Count the number of polygon references per vertex. */
+
+        memset(vv, 0, vc * sizeof (struct vert));
+
+        for (pi = 0; pi < pc; ++pi)
+        {
+            const index_t *i = O->sv[si].pv[pi].vi;
+
+            vv[i[0]].ic++;
+            vv[i[1]].ic++;
+            vv[i[2]].ic++;
+        }
+
+        /* Initialize all vertex optimization data. */
+
+        for (vi = 0, ip = iv; vi < vc; ++vi)
+        {
+            vv[vi].qs = -qc;
+            vv[vi].iv =  ip;
+            ip += vv[vi].ic;
+            vv[vi].ic =   0;
+        }
+
+        /* Fill the polygon reference list buffers. */
+
+        for (pi = 0; pi < pc; ++pi)
+        {
+            const index_t *i = O->sv[si].pv[pi].vi;
+
+            vv[i[0]].iv[vv[i[0]].ic++] = pi;
+            vv[i[1]].iv[vv[i[1]].ic++] = pi;
+            vv[i[2]].iv[vv[i[2]].ic++] = pi;
+        }
+
+        /* Iterate over the polygon array of this surface. */
+
+        for (pi = 0; pi < pc; ++pi)
+        {
+            const index_t *i = O->sv[si].pv[pi].vi;
+
+            int qd = qs - qc;
+
+            int dk = -1;    /* The best polygon score */
+            int pk = pi;    /* The best polygon index */
+
+            /* Stop between polygons if cancelled, leaving a valid order. */
+
+            if (++pd % MAXSTEP == 0 && report(O, OBJ_PROG_SORT, pd, pt))
+            {
+                halt = 1;
+                break;
+            }
+
+            /* Find the best polygon among those referred-to by the cache. */
+
+            for (qj = 0; qj < qc; ++qj)
+                if (qv[qj] >= 0)
+
+                    for (ii = 0;  ii < vv[qv[qj]].ic; ++ii)
+                    {
+                        int pj = vv[qv[qj]].iv[ii];
+                        int dj = 0;
+
+                        const index_t *j = O->sv[si].pv[pj].vi;
+
+                        /* Recently-used vertex bonus. */
+
+                        if (vv[j[0]].qs > qd) dj += vv[j[0]].qs - qd;
+                        if (vv[j[1]].qs > qd) dj += vv[j[1]].qs - qd;
+                        if (vv[j[2]].qs > qd) dj += vv[j[2]].qs - qd;
+
+                        /* Low-valence vertex bonus. */
+
+                        dj -= vv[j[0]].ic;
+                        dj -= vv[j[1]].ic;
+                        dj -= vv[j[2]].ic;
+
+                        if (dk < dj)
+                        {
+                            dk = dj;
+                            pk = pj;
+                        }
+                    }
+
+            if (pk != pi)
+            {
+                struct obj_poly temp;
+
+                /* Update the polygon reference list. */
+
+                for (vi = 0; vi < 3; ++vi)
+                    for (ii = 0; ii < vv[i[vi]].ic; ++ii)
+                        if (vv[i[vi]].iv[ii] == pi)
+                        {
+                            vv[i[vi]].iv[ii] =  pk;
+                            break;
+                        }
+
+                /* Swap the best polygon into the current position. */
+
+                temp             = O->sv[si].pv[pi];
+                O->sv[si].pv[pi] = O->sv[si].pv[pk];
+                O->sv[si].pv[pk] =  temp;
+            }
+
+            /* Iterate over the current polygon's vertices. */
+
+            for (vi = 0; vi < 3; ++vi)
+            {
+                struct vert *vp = vv + i[vi];
+
+                /* If this vertex was a cache miss then queue it. */
+
+                if (qs - vp->qs >= qc)
+                {
+                    vp->qs = qs++;
+                    qv[qi] = i[vi];
                     qi = (qi + 1) % qc;
                 }
 
-                /* Remove the current polygon from the reference list. */
+                /* Remove the current polygon from the reference list. */
+
+                vp->ic--;
+
+                for (ii = 0; ii < vp->ic; ++ii)
+                    if (vp->iv[ii] == pk)
+                    {
+                        vp->iv[ii] = vp->iv[vp->ic];
+                        break;
+                    }
+            }
+        }
+        free(iv);
+    }
+    free(qv);
+    free(vv);
+}
+
+float obj_acmr(obj *O, int qc)
+{
+    int *vs = (int *) malloc(O->vc * sizeof (int));
+    int  qs = 1;
+
+    int si;
+    int vi;
+    int pi;
+
+    int nn = 0;
+    int dd = 0;
+
+    for (si = 0; si < O->sc; ++si)
+    {
+        for (vi = 0; vi < O->vc; ++vi)
+            vs[vi] = -qc;
+
+        for (pi = 0; pi < O->sv[si].pc; ++pi)
+        {
+            const index_t *i = O->sv[si].pv[pi].vi;
+
+            if (qs - vs[i[0]] >= qc) { vs[i[0]] = qs++; nn++; }
+            if (qs - vs[i[1]] >= qc) { vs[i[1]] = qs++; nn++; }
+            if (qs - vs[i[2]] >= qc) { vs[i[2]] = qs++; nn++; }
+
+            dd++;
+        }
+    }
+
+    return (float) nn / (float) dd;
+}
+
+/*----------------------------------------------------------------------------*/
+
+#ifndef CONF_NO_GL
+
+static void obj_render_prop(const obj *O, int mi, int ki)
+{
+    const struct obj_prop *kp = O->mv[mi].kv + ki;
+
+    if (kp->map)
+    {
+        GLenum wrap = GL_REPEAT;
+
+        /* Bind the property map. */
+
+        glBindTexture(GL_TEXTURE_2D, kp->map);
+
+        /* Apply the property options. */
+
+        if (kp->opt & OBJ_OPT_CLAMP)
+            wrap = GL_CLAMP_TO_EDGE;
+
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap);
+
+        /* Apply the texture coordinate offset and scale. */
+
+        if (O->Mloc[ki] >= 0)
+        {
+            GLfloat T[16];
+
+            memset(T, 0, sizeof (T));
+
+            T[ 0] = kp->s[0];
+            T[ 5] = kp->s[1];
+            T[10] = kp->s[2];
+            T[12] = kp->o[0];
+            T[13] = kp->o[1];
+            T[14] = kp->o[2];
+            T[15] = 1.0f;
+
+            glUniformMatrix4fv(O->Mloc[ki], 1, GL_FALSE, T);
+        }
+    }
+    else glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void obj_render_mtrl(const obj *O, int mi)
+{
+    int ki;
+
+    /* Bind all material properties and texture maps. */
+
+    for (ki = 0; ki < OBJ_PROP_COUNT; ki++)
+    {
+        if (O->oloc[ki] >= 0)
+        {
+            glActiveTexture(GL_TEXTURE0 + ki);
+            obj_render_prop(O, mi, ki);
+            glUniform1i(O->oloc[ki], ki);
+        }
+        if (O->cloc[ki] >= 0)
+            glUniform4fv(O->cloc[ki], 1, O->mv[mi].kv[ki].c);
+    }
+    glActiveTexture(GL_TEXTURE0);
+}
+
+void obj_render_surf(const obj *O, int si)
+{
+    const struct obj_surf *sp = O->sv + si;
+
+    if (0 < sp->pc || sp->lc > 0)
+    {
+        /* Apply this surface's material. */
+
+        if (0 <= sp->mi && sp->mi < O->mc)
+            obj_render_mtrl(O, sp->mi);
+
+        /* Render all polygons. */
+
+        if (sp->pibo)
+        {
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sp->pibo);
+
+            if (sp->ibase >= 0)
+                glDrawElementsBaseVertex(GL_TRIANGLES, 3 * sp->pc,
+                          GL_UNSIGNED_SHORT, (const GLvoid *) 0, sp->ibase);
+            else
+                glDrawElements(GL_TRIANGLES, 3 * sp->pc,
+                          GL_INDEX_T,        (const GLvoid *) 0);
+        }
+
+        /* Render all lines. */
+
+        if (sp->libo)
+        {
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sp->libo);
+
+            if (sp->ibase >= 0)
+                glDrawElementsBaseVertex(GL_LINES, 2 * sp->lc,
+                          GL_UNSIGNED_SHORT, (const GLvoid *) 0, sp->ibase);
+            else
+                glDrawElements(GL_LINES, 2 * sp->lc,
+                          GL_INDEX_T,        (const GLvoid *) 0);
+        }
+    }
+}
+
+void obj_render(obj *O)
+{
+    int si;
+
+    assert(O);
+
+    /* Initialize the vertex arrays. */
+
+    obj_init(O);
+
+    /* Render each surface. */
+
+    glBindVertexArray(O->vao);
+
+    for (si = 0; si < O->sc; ++si)
+        obj_render_surf(O, si);
+}
+
+#else
+
+void obj_render(obj *O)
+{
+}
+
+#endif
+
+/*============================================================================*/
+
+void obj_bound(const obj *O, float *b)
+{
+    int vi;
+
+    assert(O);
+
+    /* Compute the bounding box of this object. */
+
+    if (O->vc > 0)
+    {
+        const float *v = O->vv[0];
+
+        b[0] = b[3] = v[0];
+        b[1] = b[4] = v[1];
+        b[2] = b[5] = v[2];
+    }
+
+    for (vi = 0; vi < O->vc; ++vi)
+    {
+        const float *v = O->vv[vi];
+
+        if (b[0] > v[0]) b[0] = v[0];
+        if (b[1] > v[1]) b[1] = v[1];
+        if (b[2] > v[2]) b[2] = v[2];
+
+        if (b[3] < v[0]) b[3] = v[0];
+        if (b[4] < v[1]) b[4] = v[1];
+        if (b[5] < v[2]) b[5] = v[2];
+    }
+}
+
+/*============================================================================*/
+
+static void obj_write_map(FILE *fout, const obj *O, int mi, int ki, const char *s)
+{
+    struct obj_prop *kp = O->mv[mi].kv + ki;
+
+    /* If this property has a map... */
+
+    if (kp->str)
+    {
+        fprintf(fout, "map_%s ", s);
+
+        /* Store all map options. */
+
+        if ((kp->opt & OBJ_OPT_CLAMP) != 0) fprintf(fout, "-clamp on ");
+
+        /* Store the map offset, if any. */
+
+        if (fabs(kp->o[0]) > 0 ||
+            fabs(kp->o[1]) > 0 ||
+            fabs(kp->o[2]) > 0) fprintf(fout, "-o %f %f %f ",
+                                        kp->o[0], kp->o[1], kp->o[2]);
+
+        /* Store the map scale, if any. */
+
+        if (fabs(kp->s[0] - 1) > 0 ||
+            fabs(kp->s[1] - 1) > 0 ||
+            fabs(kp->s[2] - 1) > 0) fprintf(fout, "-s %f %f %f ",
+                                            kp->s[0], kp->s[1], kp->s[2]);
+
+        /* Store the map image file name. */
+
+        fprintf(fout, "%s\n", kp->str);
+    }
+}
+
+static void obj_write_mtl(const obj *O, const char *mtl)
+{
+    FILE *fout;
+    int   mi;
+
+    if ((fout = fopen(mtl, "w")))
+    {
+        for (mi = 0; mi < O->mc; ++mi)
+        {
+            struct obj_mtrl *mp = O->mv + mi;
+
+            /* Start a new material. */
+
+            if (mp->name)
+                fprintf(fout, "newmtl %s\n", mp->name);
+            else
+                fprintf(fout, "newmtl default\n");
+
+            /* Store all material property colors. */
+
+            fprintf(fout, "Kd %12.8f %12.8f %12.8f\n", mp->kv[OBJ_KD].c[0],
+                                                       mp->kv[OBJ_KD].c[1],
+                                                       mp->kv[OBJ_KD].c[2]);
+            fprintf(fout, "Ka %12.8f %12.8f %12.8f\n", mp->kv[OBJ_KA].c[0],
+                                                       mp->kv[OBJ_KA].c[1],
+                                                       mp->kv[OBJ_KA].c[2]);
+            fprintf(fout, "Ke %12.8f %12.8f %12.8f\n", mp->kv[OBJ_KE].c[0],
+                                                       mp->kv[OBJ_KE].c[1],
+                                                       mp->kv[OBJ_KE].c[2]);
+            fprintf(fout, "Ks %12.8f %12.8f %12.8f\n", mp->kv[OBJ_KS].c[0],
+                                                       mp->kv[OBJ_KS].c[1],
+                                                       mp->kv[OBJ_KS].c[2]);
+
+            fprintf(fout, "Ns %12.8f\n", mp->kv[OBJ_NS].c[0]);
+            fprintf(fout, "d  %12.8f\n", mp->kv[OBJ_KD].c[3]);
+
+            /* Store all material property maps. */
+
+            obj_write_map(fout, O, mi, OBJ_KD, "Kd");
+            obj_write_map(fout, O, mi, OBJ_KA, "Ka");
+            obj_write_map(fout, O, mi, OBJ_KA, "Ke");
+            obj_write_map(fout, O, mi, OBJ_KS, "Ks");
+            obj_write_map(fout, O, mi, OBJ_NS, "Ns");
+            obj_write_map(fout, O, mi, OBJ_KN, "Kn");
+        }
+    }
+    fclose(fout);
+}
+
+/*----------------------------------------------------------------------------*/
+
+/* OBJ text is formatted into a large buffer passed to a writer function as   */
+/* it fills. Floats are formatted exactly as printf's %.Nf would format them, */
+/* with round-half-even on ties, by scaling the float's integer significand   */
+/* by a power of ten. Values too large for 64-bit arithmetic, non-finite      */
+/* values, and precisions past 12 digits fall back on sprintf.                */
+
+#define OUT_PREC 12
+
+struct obj_out
+{
+    obj_writer fn;              /* Writer function                      */
+    void      *data;            /* Writer data                          */
+    char      *p;               /* Output buffer                        */
+    size_t     n;               /* Bytes held in the buffer             */
+    size_t     m;               /* Size of the buffer                   */
+    int        ok;              /* No write has failed                  */
+};
+
+static const uint64_t out_pow[OUT_PREC + 1] = {
+    1U,
+    10U,
+    100U,
+    1000U,
+    10000U,
+    100000U,
+    1000000U,
+    10000000U,
+    100000000U,
+    1000000000U,
+    (uint64_t) 1000000000U * 10U,
+    (uint64_t) 1000000000U * 100U,
+    (uint64_t) 1000000000U * 1000U,
+};
+
+static int file_writer(void *data, const void *p, size_t n)
+{
+    return (fwrite(p, 1, n, (FILE *) data) == n);
+}
+
+static int out_init(struct obj_out *W, obj_writer fn, void *data, int prec)
+{
+    /* Size the buffer to hold many of the longest vertex records. */
+
+    W->fn   = fn;
+    W->data = data;
+    W->n    = 0;
+    W->m    = MAXBUF;
+    W->ok   = 1;
+
+    if (W->m < 64 * (size_t) prec)
+        W->m = 64 * (size_t) prec;
+
+    return ((W->p = (char *) malloc(W->m)) != NULL);
+}
+
+static void out_flush(struct obj_out *W)
+{
+    if (W->ok && W->n)
+        W->ok = W->fn(W->data, W->p, W->n);
+
+    W->n = 0;
+}
+
+static char *out_room(struct obj_out *W, size_t n)
+{
+    char *p;
+
+    /* If the buffer cannot hold n more bytes, flush it to the writer or,  */
+    /* lacking a writer, grow it.                                          */
+
+    if (W->n + n > W->m)
+    {
+        if (W->fn)
+            out_flush(W);
+        else if ((p = (char *) realloc(W->p, 2 * (W->n + n))))
+        {
+            W->p = p;
+            W->m = 2 * (W->n + n);
+        }
+        else
+        {
+            W->ok = 0;
+            W->n  = 0;
+        }
+    }
+    return W->p + W->n;
+}
+
+static void out_str(struct obj_out *W, const char *s)
+{
+    size_t n = strlen(s);
+    size_t k;
+
+    /* Copy a string of any length, flushing as the buffer fills. */
+
+    while (n)
+    {
+        out_room(W, 1);
+
+        k = (W->m - W->n < n) ? W->m - W->n : n;
+
+        memcpy(W->p + W->n, s, k);
+
+        W->n += k;
+        s    += k;
+        n    -= k;
+    }
+}
+
+static char *put_uint(char *c, uint64_t u, int w)
+{
+    char t[24];
+    int  i = 0;
+
+    /* Write u in decimal with at least w digits. */
+
+    do
+    {
+        t[i++] = (char) ('0' + u % 10);
+        u /= 10;
+    }
+    while (u || i < w);
+
+    while (i)
+        *c++ = t[--i];
+
+    return c;
+}
+
+static char *put_float(char *c, float f, int prec)
+{
+    uint32_t b;
+    uint64_t m;
+    uint64_t i;
+    uint64_t q;
+    uint64_t r;
+    uint64_t h;
+    int      e;
+
+    memcpy(&b, &f, sizeof (uint32_t));
+
+    /* Split the float into significand m and exponent e, f = m * 2^e. */
+
+    m = (b & 0x7FFFFF);
+    e = (b >> 23) & 0xFF;
+
+    if (e == 0xFF || e > 150 + 40 || prec < 0 || prec > OUT_PREC)
+        return c + sprintf(c, "%.*f", prec, f);
+
+    if (e) m |= 0x800000; else e = 1;
+
+    e -= 150;
+
+    /* Find the integer part i and the fraction q scaled by 10^prec and */
+    /* rounded half-even.                                                */
+
+    if (e >= 0)
+    {
+        i = m << e;
+        q = 0;
+    }
+    else
+    {
+        q = m * out_pow[prec];
+
+        if (-e < 64)
+        {
+            r = q & (((uint64_t) 1 << -e) - 1);
+            h =       ((uint64_t) 1 << -e) / 2;
+            q = q >> -e;
+
+            if (r > h || (r == h && (q & 1)))
+                q++;
+        }
+        else q = (-e == 64 && q > ((uint64_t) 1 << 63));
+
+        i = q / out_pow[prec];
+        q = q % out_pow[prec];
+    }
+
+    /* Write the sign, the integer part, and the fraction. */
+
+    if (b >> 31)
+        *c++ = '-';
+
+    c = put_uint(c, i, 1);
+
+    if (prec)
+    {
+        *c++ = '.';
+        c = put_uint(c, q, prec);
+    }
+    return c;
+}
+
+static void out_vec(struct obj_out *W, const char *s, const float *v, int k,
+                                                                   int prec)
+{
+    char *c = out_room(W, 8 + k * (48 + (size_t) prec));
+    int   i;
+
+    /* Write a vector record with k components. */
+
+    while (*s)
+        *c++ = *s++;
+
+    for (i = 0; i < k; ++i)
+    {
+        *c++ = ' ';
+        c = put_float(c, v[i], prec);
+    }
+    *c++ = '\n';
+
+    W->n = (size_t) (c - W->p);
+}
+
+static void out_elem(struct obj_out *W, const char *s, const index_t *vi,
+                                                             int k)
+{
+    char *c = out_room(W, 8 + k * 36);
+    char  t[12];
+    int   i;
+    int   n;
+
+    /* Write an element record with k vertices, each v/t/n alike. */
+
+    while (*s)
+        *c++ = *s++;
+
+    for (i = 0; i < k; ++i)
+    {
+        n = (int) (put_uint(t, (uint64_t) vi[i] + 1, 1) - t);
+
+        *c++ = ' ';
+        memcpy(c, t, n); c += n; *c++ = '/';
+        memcpy(c, t, n); c += n; *c++ = '/';
+        memcpy(c, t, n); c += n;
+    }
+    *c++ = '\n';
+
+    W->n = (size_t) (c - W->p);
+}
+
+/*----------------------------------------------------------------------------*/
+
+/* A compact write gives each distinct position, texture coordinate, and     */
+/* normal a single record, comparing them bit for bit by hashing, and omits  */
+/* the texture coordinate or normal records if all are zero. Element corners */
+/* then give separate v/vt/vn indices, or v//vn, v/vt, or v alone.           */
+
+struct out_attr
+{
+    int  c;                     /* Distinct values, 0 if omitted        */
+    int *uv;                    /* Vertex giving each distinct value    */
+    int *xv;                    /* Distinct value of each vertex        */
+};
+
+static int uniq_attr(const obj *O, struct out_attr *A, const float *a,
+                                     size_t k, int z)
+{
+    uint32_t w[3] = { 0, 0, 0 };
+    float    f[3];
+    size_t   m = 2;
+    size_t   i;
+    int     *hv;
+    int      vi;
+
+    /* Size an open-addressed table to remain at most half full. */
+
+    while (m < 2 * (size_t) O->vc)
+        m *= 2;
+
+    A->c  = 0;
+    A->uv = (int *) malloc((O->vc + 1) * sizeof (int));
+    A->xv = (int *) malloc((O->vc + 1) * sizeof (int));
+
+    if (A->uv == NULL || A->xv == NULL ||
+        (hv = (int *) malloc(m * sizeof (int))) == NULL)
+        return 0;
+
+    for (i = 0; i < m; ++i)
+        hv[i] = -1;
+
+    /* Find the first vertex with each distinct value of the attribute. */
+
+    for (vi = 0; vi < O->vc; ++vi)
+    {
+        const float *p = a + k * vi;
+
+        memcpy(w, p, k * sizeof (float));
+
+        i = hash_iset((int) w[0], (int) w[1], (int) w[2], 0) & (m - 1);
+
+        while (hv[i] >= 0 && memcmp(a + k * A->uv[hv[i]], p,
+                                    k * sizeof (float)))
+            i = (i + 1) & (m - 1);
+
+        if (hv[i] < 0)
+        {
+            hv[i] = A->c;
+            A->uv[A->c++] = vi;
+        }
+        A->xv[vi] = hv[i];
+    }
+    free(hv);
+
+    /* If allowed, omit the attribute if its only value is zero, or NaN as */
+    /* read for an absent normal.                                         */
+
+    if (A->c == 1 && z)
+    {
+        memcpy(f, a, k * sizeof (float));
+
+        for (i = 0; i < k && (f[i] == 0 || f[i] != f[i]); ++i)
+            ;
+        if (i == k)
+            A->c = 0;
+    }
+    return 1;
+}
+
+static void out_elem_attr(struct obj_out *W, const char *s, const index_t *vi,
+                                       const struct out_attr *A, int k)
+{
+    char *c = out_room(W, 8 + k * 36);
+    int   i;
+
+    /* Write an element record with k vertices and separate indices. */
+
+    while (*s)
+        *c++ = *s++;
+
+    for (i = 0; i < k; ++i)
+    {
+        *c++ = ' ';
+        c = put_uint(c, (uint64_t) A[0].xv[vi[i]] + 1, 1);
+
+        if (A[1].c || A[2].c)
+            *c++ = '/';
+        if (A[1].c)
+            c = put_uint(c, (uint64_t) A[1].xv[vi[i]] + 1, 1);
+        if (A[2].c)
+        {
+            *c++ = '/';
+            c = put_uint(c, (uint64_t) A[2].xv[vi[i]] + 1, 1);
+        }
+    }
+    *c++ = '\n';
+
+    W->n = (size_t) (c - W->p);
+}
+
+/*----------------------------------------------------------------------------*/
+
+/* The records of an OBJ are divided into parts of at most OUT_PART records  */
+/* of one type. A part of faces begins with its surface's usemtl statement,  */
+/* so every surface has at least one. Parts are formatted in file order,     */
+/* either serially into one buffer or in parallel into one per thread.       */
+
+#define OUT_PART  65536
+#define OUT_BATCH 4
+
+enum { OUT_V, OUT_T, OUT_N, OUT_F, OUT_L };
+
+struct out_part
+{
+    int k;                      /* Record type                          */
+    int si;                     /* Surface index                        */
+    int i0;                     /* First record                         */
+    int i1;                     /* Record limit                         */
+};
+
+static int add_parts(struct out_part *P, int k, int si, int n, int m)
+{
+    int c = 0;
+    int i;
+
+    /* Divide n records into parts, at least m of them, and count them. */
+
+    for (i = 0; i < n || c < m; i += OUT_PART, ++c)
+        if (P)
+        {
+            P[c].k  = k;
+            P[c].si = si;
+            P[c].i0 = i;
+            P[c].i1 = (n - i < OUT_PART) ? n : i + OUT_PART;
+        }
+
+    return c;
+}
+
+static int out_parts(const obj *O, const struct out_attr *A,
+                                         struct out_part *P)
+{
+    int c = 0;
+    int si;
+
+    /* List the parts of an OBJ in file order, or just count them. */
+
+    c += add_parts(P ? P + c : NULL, OUT_V, 0, A ? A[0].c : O->vc, 0);
+    c += add_parts(P ? P + c : NULL, OUT_T, 0, A ? A[1].c : O->vc, 0);
+    c += add_parts(P ? P + c : NULL, OUT_N, 0, A ? A[2].c : O->vc, 0);
+
+    for (si = 0; si < O->sc; ++si)
+    {
+        c += add_parts(P ? P + c : NULL, OUT_F, si, O->sv[si].pc, 1);
+        c += add_parts(P ? P + c : NULL, OUT_L, si, O->sv[si].lc, 0);
+    }
+    return c;
+}
+
+static void out_part(struct obj_out *W, const obj *O, const struct out_attr *A,
+                                      const struct out_part *P, int prec)
+{
+    const struct obj_surf *sp = O->sv + P->si;
+
+    int i;
+
+    switch (P->k)
+    {
+    case OUT_V:
+        for (i = P->i0; i < P->i1 && W->ok; ++i)
+            out_vec(W, "v",  O->vv[A ? A[0].uv[i] : i], 3, prec);
+        break;
+    case OUT_T:
+        for (i = P->i0; i < P->i1 && W->ok; ++i)
+            out_vec(W, "vt", O->tv[A ? A[1].uv[i] : i], 2, prec);
+        break;
+    case OUT_N:
+        for (i = P->i0; i < P->i1 && W->ok; ++i)
+            out_vec(W, "vn", O->nv[A ? A[2].uv[i] : i], 3, prec);
+        break;
+
+    case OUT_F:
+
+        /* Store the surface's material reference */
+
+        if (P->i0 == 0)
+        {
+            if (0 <= sp->mi && sp->mi < O->mc && O->mv[sp->mi].name)
+            {
+                out_str(W, "usemtl ");
+                out_str(W, O->mv[sp->mi].name);
+                out_str(W, "\n");
+            }
+            else
+                out_str(W, "usemtl default\n");
+        }
+
+        for (i = P->i0; i < P->i1 && W->ok; ++i)
+            if (A)
+                out_elem_attr(W, "f", sp->pv[i].vi, A, 3);
+            else
+                out_elem     (W, "f", sp->pv[i].vi,    3);
+        break;
+
+    case OUT_L:
+        for (i = P->i0; i < P->i1 && W->ok; ++i)
+            if (A)
+                out_elem_attr(W, "l", sp->lv[i].vi, A, 2);
+            else
+                out_elem     (W, "l", sp->lv[i].vi,    2);
+        break;
+    }
+}
+
+#ifndef CONF_NO_THREADS
+
+struct out_task
+{
+    const obj             *O;
+    const struct out_attr *A;   /* Distinct attributes, if compact      */
+    const struct out_part *P;   /* First part to format                 */
+    int                    pc;  /* Number of parts to format            */
+    int                    prec;
+
+    pthread_t      thread;
+    int            joinable;
+    struct obj_out W;           /* Growing buffer without a writer      */
+};
+
+static void *out_task(void *data)
+{
+    struct out_task *T = (struct out_task *) data;
+
+    int i;
+
+    for (i = 0; i < T->pc && T->W.ok; ++i)
+        out_part(&T->W, T->O, T->A, T->P + i, T->prec);
+
+    return NULL;
+}
+
+static void out_parts_threads(struct obj_out *W, const obj *O,
+                              const struct out_attr *A,
+                              const struct out_part *P, int pc,
+                              int prec, int n)
+{
+    struct out_task *T;
+
+    int i;
+    int j;
+    int k;
+
+    /* Give each thread consecutive parts totalling OUT_BATCH full parts, */
+    /* format them concurrently using this thread for the first, and      */
+    /* write the buffers in order.                                        */
+
+    if ((T = (struct out_task *) calloc(n, sizeof (struct out_task))))
+    {
+        for (i = 0; i < n; ++i)
+        {
+            T[i].O    = O;
+            T[i].A    = A;
+            T[i].prec = prec;
+
+            if (out_init(&T[i].W, NULL, NULL, prec) == 0)
+                W->ok = 0;
+        }
+
+        out_flush(W);
+
+        for (j = 0; j < pc && W->ok; )
+        {
+            for (i = 0; i < n; ++i)
+            {
+                T[i].P   = P + j;
+                T[i].pc  = 0;
+                T[i].W.n = 0;
+
+                for (k = 0; j < pc && k < OUT_BATCH * OUT_PART; ++j)
+                {
+                    k += P[j].i1 - P[j].i0 + 1;
+                    T[i].pc++;
+                }
+            }
+
+            for (i = 1; i < n; ++i)
+                T[i].joinable = !pthread_create(&T[i].thread, NULL,
+                                                out_task, T + i);
+            out_task(T);
+
+            for (i = 1; i < n; ++i)
+                if (T[i].joinable)
+                    pthread_join(T[i].thread, NULL);
+                else
+                    out_task(T + i);
+
+            for (i = 0; i < n; ++i)
+                if (T[i].W.ok == 0)
+                    W->ok = 0;
+                else if (W->ok && T[i].W.n)
+                    W->ok = W->fn(W->data, T[i].W.p, T[i].W.n);
+        }
+
+        for (i = 0; i < n; ++i)
+            free(T[i].W.p);
+
+        free(T);
+    }
+    else W->ok = 0;
+}
+
+#endif
+
+static int write_obj(const obj *O, obj_writer fn, void *data,
+                                   const char *mtl, int prec)
+{
+    struct out_attr  V[3];
+    struct out_attr *A = NULL;
+    struct out_part *P = NULL;
+    struct obj_out   W;
+
+    int pc;
+    int pi;
+    int ok = 1;
+
+    if (prec < 0)
+        prec = 0;
+
+    /* Find the distinct attribute values for a compact write. */
+
+    memset(V, 0, sizeof (V));
+
+    if (O->wopt & OBJ_WRITE_COMPACT)
+    {
+        A = V;
+        ok = uniq_attr(O, A + 0, (const float *) O->vv, 3, 0)
+          && uniq_attr(O, A + 1, (const float *) O->tv, 2, 1)
+          && uniq_attr(O, A + 2, (const float *) O->nv, 3, 1);
+    }
+
+    /* List the parts of the file. */
+
+    pc = out_parts(O, A, NULL);
+
+    if (ok && (P = (struct out_part *) malloc((pc + 1) *
+                                              sizeof (struct out_part))))
+        out_parts(O, A, P);
+    else
+        ok = 0;
+
+    /* Format and write all parts. */
+
+    if (ok && out_init(&W, fn, data, prec))
+    {
+        if (mtl)
+        {
+            out_str(&W, "mtllib ");
+            out_str(&W, mtl);
+            out_str(&W, "\n");
+        }
+
+#ifndef CONF_NO_THREADS
+        if (O->threads > 1)
+            out_parts_threads(&W, O, A, P, pc, prec, O->threads);
+        else
+#endif
+        for (pi = 0; pi < pc && W.ok; ++pi)
+            out_part(&W, O, A, P + pi, prec);
+
+        out_flush(&W);
+        free(W.p);
+
+        ok = W.ok;
+    }
+    else ok = 0;
+
+    for (pi = 0; pi < 3; ++pi)
+    {
+        free(V[pi].uv);
+        free(V[pi].xv);
+    }
+    free(P);
+
+    return ok;
+}
+
+static void obj_write_obj(const obj *O, const char *obj,
+                                        const char *mtl, int prec)
+{
+    FILE *fout;
+
+    if ((fout = fopen(obj, "w")))
+    {
+        write_obj(O, file_writer, fout, mtl, prec);
+        fclose(fout);
+    }
+}
+
+int obj_write_to(const obj *O, obj_writer fn, void *data, const char *mtl,
+                                                          int prec)
+{
+    assert(O);
+    assert(fn);
+    assert(prec >= 0);
+
+    return write_obj(O, fn, data, mtl, prec);
+}
+
+void obj_write(const obj *O, const char *obj, const char *mtl, int prec)
+{
+    assert(O);
+
+    if (obj) obj_write_obj(O, obj, mtl, prec);
+    if (mtl) obj_write_mtl(O, mtl);
+}
+
+/*============================================================================*/
+/* Binary snapshot                                                            */
+
+/* A snapshot holds a processed OBJ as a header followed by an optional cache */
+/* key, its materials, its four vertex attribute arrays, and each surface's   */
+/* polygon and line arrays. Arrays are stored in native layout at 16-byte     */
+/* alignment and are read in bulk. The header records byte order and element  */
+/* sizes, and a snapshot written on an incompatible platform is rejected, not */
+/* converted.                                                                 */
+
+#define BIN_MAGIC   "OBJB"
+#define BIN_ORDER   0x01020304
+#define BIN_VERSION 3
+#define BIN_ALIGN   16
+#define BIN_MAXSTR  65536
+
+struct bin_head
+{
+    char     magic[4];          /* File type, "OBJB"                    */
+    uint32_t order;             /* BIN_ORDER in the writer's byte order */
+    uint32_t version;           /* Format version                       */
+    uint32_t vs;                /* Size of a vertex                     */
+    uint32_t ps;                /* Size of a polygon                    */
+    uint32_t ls;                /* Size of a line                       */
+    uint32_t mc;                /* Material count                       */
+    uint32_t vc;                /* Vertex count                         */
+    uint32_t sc;                /* Surface count                        */
+    uint32_t pad;
+    uint64_t size;              /* Payload size in bytes                */
+    uint32_t sum[2];            /* Payload checksum                     */
+    uint32_t reserved[2];
+};
+
+struct bin
+{
+    FILE       *fp;             /* File, or NULL for a mapped payload   */
+    const char *p;              /* Mapped payload                       */
+    uint64_t    m;              /* Mapped payload size                  */
+    uint64_t    n;              /* Payload bytes transferred            */
+    uint32_t    a;              /* Running checksum sums                */
+    uint32_t    b;
+    int         ok;             /* No transfer has failed               */
+};
+
+static void bin_sum(struct bin *B, const void *p, size_t n)
+{
+    const unsigned char *c = (const unsigned char *) p;
+
+    uint32_t a = B->a;
+    uint32_t b = B->b;
+    uint32_t w;
+    size_t   i;
+
+    /* Accumulate a Fletcher checksum of 32-bit words, zero-extending any */
+    /* partial final word.                                                 */
+
+    for (i = 0; i + 4 <= n; i += 4)
+    {
+        memcpy(&w, c + i, 4);
+        a += w;
+        b += a;
+    }
+    if (i < n)
+    {
+        w = 0;
+        memcpy(&w, c + i, n - i);
+        a += w;
+        b += a;
+    }
+    B->a = a;
+    B->b = b;
+}
+
+static void bin_put(struct bin *B, const void *p, size_t n)
+{
+    if (B->ok && n > 0)
+    {
+        if (fwrite(p, 1, n, B->fp) == n)
+        {
+            bin_sum(B, p, n);
+            B->n += n;
+        }
+        else B->ok = 0;
+    }
+}
+
+static void bin_get(struct bin *B, void *p, size_t n)
+{
+    if (B->ok && n > 0)
+    {
+        if (B->fp == NULL && n <= B->m - B->n)
+            memcpy(p, B->p + B->n, n);
+
+        else if (B->fp == NULL || fread(p, 1, n, B->fp) != n)
+        {
+            B->ok = 0;
+            return;
+        }
+        bin_sum(B, p, n);
+        B->n += n;
+    }
+}
+
+static void *bin_array(struct bin *B, size_t n)
+{
+    void *p = NULL;
+
+    /* Read an array in bulk, or point into a mapped payload. */
+
+    if (B->ok && B->fp == NULL && n <= B->m - B->n)
+    {
+        p     = (void *) (B->p + B->n);
+        B->n += n;
+    }
+    else if (B->ok && B->fp && (p = malloc(n)))
+    {
+        bin_get(B, p, n);
+
+        if (B->ok == 0)
+        {
+            free(p);
+            p = NULL;
+        }
+    }
+    if (p == NULL)
+        B->ok = 0;
+
+    return p;
+}
+
+static void bin_pad(struct bin *B, int align, int put)
+{
+    char z[BIN_ALIGN];
+
+    size_t n = (size_t) ((align - B->n % align) % align);
+
+    /* Pad the payload to the given alignment. */
+
+    memset(z, 0, BIN_ALIGN);
+
+    if (put)
+        bin_put(B, z, n);
+    else
+        bin_get(B, z, n);
+}
+
+static void bin_put_u(struct bin *B, uint32_t u)
+{
+    bin_put(B, &u, 4);
+}
+
+static uint32_t bin_get_u(struct bin *B)
+{
+    uint32_t u = 0;
+
+    bin_get(B, &u, 4);
+    return u;
+}
+
+static void bin_put_str(struct bin *B, const char *str)
+{
+    uint32_t n = str ? (uint32_t) strlen(str) + 1 : 0;
+
+    /* Store a string's length with its null, or zero for no string. */
+
+    bin_put_u(B, n);
+    bin_put  (B, str, n);
+    bin_pad  (B, 4, 1);
+}
+
+static char *bin_get_str(struct bin *B)
+{
+    uint32_t n = bin_get_u(B);
+    char    *str = NULL;
+
+    /* Load a string of plausible length, or return NULL for no string. */
+
+    if (B->ok && n > 0 && n <= BIN_MAXSTR && (str = (char *) malloc(n)))
+    {
+        bin_get(B, str, n);
+        bin_pad(B, 4, 0);
+
+        if (B->ok && str[n - 1] == '\0')
+            return str;
+    }
+    free(str);
+
+    if (n > 0)
+        B->ok = 0;
+
+    return NULL;
+}
+
+static void bin_put_mtrl(struct bin *B, const struct obj_mtrl *mp)
+{
+    int ki;
+
+    bin_put_str(B, mp->name);
+
+    for (ki = 0; ki < OBJ_PROP_COUNT; ++ki)
+    {
+        const struct obj_prop *kp = mp->kv + ki;
+
+        bin_put_str(B, kp->str);
+        bin_put_u  (B, (uint32_t) kp->opt);
+        bin_put    (B, kp->c, sizeof (kp->c));
+        bin_put    (B, kp->o, sizeof (kp->o));
+        bin_put    (B, kp->s, sizeof (kp->s));
+    }
+}
+
+static void bin_get_mtrl(struct bin *B, obj *O, int mi, int defer)
+{
+    struct obj_mtrl *mp = O->mv + mi;
+
+    char *str;
+    int   ki;
+
+    mp->name = bin_get_str(B);
+
+    for (ki = 0; ki < OBJ_PROP_COUNT && B->ok; ++ki)
+    {
+        struct obj_prop *kp = mp->kv + ki;
+
+        str     = bin_get_str(B);
+        kp->opt = (int) bin_get_u(B);
+
+        bin_get(B, kp->c, sizeof (kp->c));
+        bin_get(B, kp->o, sizeof (kp->o));
+        bin_get(B, kp->s, sizeof (kp->s));
+
+        /* Share the map image, as obj_set_mtrl_map would. */
+
+        if (str)
+        {
+            set_map(O, mi, ki, str, get_image(str));
+
+            if (defer == 0)
+                bind_map(O, mi, ki);
+
+            free(str);
+        }
+    }
+}
+
+static int bin_check(const obj *O)
+{
+    const index_t vc = (index_t) O->vc;
+
+    int si;
+    int pi;
+    int li;
+
+    /* Confirm that all references are in range. */
+
+    for (si = 0; si < O->sc; ++si)
+    {
+        const struct obj_surf *sp = O->sv + si;
+
+        if (sp->mi < 0 || sp->mi >= O->mc)
+            return 0;
+
+        for (pi = 0; pi < sp->pc; ++pi)
+            if (sp->pv[pi].vi[0] >= vc ||
+                sp->pv[pi].vi[1] >= vc ||
+                sp->pv[pi].vi[2] >= vc)
+                return 0;
+
+        for (li = 0; li < sp->lc; ++li)
+            if (sp->lv[li].vi[0] >= vc ||
+                sp->lv[li].vi[1] >= vc)
+                return 0;
+    }
+    return 1;
+}
+
+static int bin_fits(const struct bin *B, const struct bin_head *H,
+                    uint32_t c, uint32_t s)
+{
+    /* Confirm that an array of c elements of size s fits the payload. */
+
+    return B->ok && (uint64_t) c * s <= H->size - B->n;
+}
+
+static void bin_get_surf(struct bin *B, const struct bin_head *H,
+                         struct obj_surf *sp)
+{
+    uint32_t mi;
+    uint32_t pc;
+    uint32_t lc;
+
+    mi = bin_get_u(B);
+    pc = bin_get_u(B);
+    lc = bin_get_u(B);
+    bin_pad(B, BIN_ALIGN, 0);
+
+    /* The materials precede the surfaces, so the index may be checked here. */
+
+    if (mi >= H->mc)
+        B->ok = 0;
+    else
+        sp->mi = (int) mi;
+
+    if (bin_fits(B, H, pc, H->ps) == 0 ||
+        bin_fits(B, H, lc, H->ls) == 0)
+        B->ok = 0;
+
+    /* Read the polygon and line arrays in bulk. */
+
+    if (B->ok && pc > 0)
+    {
+        if ((sp->pv = (struct obj_poly *) bin_array(B, (size_t) pc * H->ps)))
+            sp->pc = sp->pm = (int) pc;
+    }
+    bin_pad(B, BIN_ALIGN, 0);
+
+    if (B->ok && lc > 0)
+    {
+        if ((sp->lv = (struct obj_line *) bin_array(B, (size_t) lc * H->ls)))
+            sp->lc = sp->lm = (int) lc;
+    }
+    bin_pad(B, BIN_ALIGN, 0);
+}
+
+static void bin_head_init(struct bin_head *H, const char *magic,
+                          uint32_t vs, uint32_t ps, uint32_t ls)
+{
+    /* Describe the expected file type and this platform's layout. */
+
+    memset(H, 0, sizeof (struct bin_head));
+    memcpy(H->magic, magic, 4);
+
+    H->order   = BIN_ORDER;
+    H->version = BIN_VERSION;
+    H->vs      = vs;
+    H->ps      = ps;
+    H->ls      = ls;
+}
+
+static int bin_head_ok(const struct bin_head *H, const struct stat *st,
+                       const struct bin_head *K)
+{
+    /* Validate a header against the expected one and the file's size. */
+
+    return (H->size == (uint64_t) st->st_size - sizeof (struct bin_head) &&
+            memcmp(H->magic, K->magic, 4) == 0 &&
+            H->order   == K->order   &&
+            H->version == K->version &&
+            H->vs      == K->vs      &&
+            H->ps      == K->ps      &&
+            H->ls      == K->ls      &&
+            H->mc <= H->size && H->vc < INT_MAX && H->sc <= H->size &&
+            H->pad == 0 && H->reserved[0] == 0 && H->reserved[1] == 0);
+}
+
+static int bin_open(struct bin *B, struct bin_head *H, const char *filename,
+                                                 const struct bin_head *K)
+{
+    struct stat st;
+
+    /* Open the named file and read and validate its header. */
+
+    memset(B, 0, sizeof (struct bin));
+
+    if (stat(filename, &st) != 0 || (B->fp = fopen(filename, "rb")) == NULL)
+        return 0;
+
+    if (fread(H, sizeof (struct bin_head), 1, B->fp) == 1 &&
+        bin_head_ok(H, &st, K))
+        B->ok = 1;
+
+    return 1;
+}
+
+static int bin_close(struct bin *B, const struct bin_head *H)
+{
+    /* Accept the payload only if it was read whole and intact. */
+
+    if (B->n != H->size || B->a != H->sum[0] || B->b != H->sum[1])
+        B->ok = 0;
+
+    fclose(B->fp);
+
+    return B->ok;
+}
+
+static int bin_begin(struct bin *B, const struct bin_head *H,
+                     const char *filename)
+{
+    /* Create the named file and reserve its header. */
+
+    memset(B, 0, sizeof (struct bin));
+
+    if ((B->fp = fopen(filename, "wb")) == NULL)
+        return 0;
+
+    if (fwrite(H, sizeof (struct bin_head), 1, B->fp) == 1)
+        B->ok = 1;
+
+    return 1;
+}
 
-                vp->ic--;
+static int bin_end(struct bin *B, struct bin_head *H)
+{
+    /* Complete the header with the payload size and checksum. */
 
-                for (ii = 0; ii < vp->ic; ++ii)
-                    if (vp->iv[ii] == pk)
-                    {
-                        vp->iv[ii] = vp->iv[vp->ic];
-                        break;
-                    }
+    H->size   = B->n;
+    H->sum[0] = B->a;
+    H->sum[1] = B->b;
+
+    if (B->ok == 0 || fseek(B->fp, 0, SEEK_SET) != 0 ||
+        fwrite(H, sizeof (struct bin_head), 1, B->fp) != 1)
+        B->ok = 0;
+
+    if (fclose(B->fp) != 0)
+        B->ok = 0;
+
+    return B->ok;
+}
+
+static void bin_get_body(struct bin *B, const struct bin_head *H, obj *O,
+                         const char *key, int defer)
+{
+    void **p;
+    size_t s;
+    char  *str;
+    int    mi;
+    int    si;
+    int    k;
+
+    /* Read the cache key and check it against any expected key. */
+
+    str = bin_get_str(B);
+
+    if (key && (str == NULL || check_key(str, key) == 0))
+        B->ok = 0;
+
+    free(str);
+
+    /* Read the materials. */
+
+    for (mi = 0; mi < (int) H->mc && B->ok; ++mi)
+        if (obj_add_mtrl(O) == mi)
+            bin_get_mtrl(B, O, mi, defer);
+        else
+            B->ok = 0;
+
+    bin_pad(B, BIN_ALIGN, 0);
+
+    /* Read the vertex attribute arrays in bulk. */
+
+    if (bin_fits(B, H, H->vc, H->vs) == 0)
+        B->ok = 0;
+
+    if (B->ok && H->vc > 0)
+    {
+        for (k = 0; k < VERT_ARRAYS && B->ok; ++k)
+        {
+            p  = vert_array(O, k, &s);
+            *p = bin_array(B, (size_t) H->vc * s);
+
+            bin_pad(B, BIN_ALIGN, 0);
+        }
+        if (B->ok)
+            O->vc = O->vm = (int) H->vc;
+    }
+
+    /* Read each surface's polygon and line arrays in bulk. */
+
+    for (si = 0; si < (int) H->sc && B->ok; ++si)
+        if (obj_add_surf(O) == si)
+            bin_get_surf(B, H, O->sv + si);
+        else
+            B->ok = 0;
+
+    if (B->n != H->size)
+        B->ok = 0;
+}
+
+static int read_bin(obj *O, const char *filename, const char *key,
+                                                    int defer)
+{
+    struct bin_head K;
+    struct bin_head H;
+    struct bin      B;
+
+    bin_head_init(&K, BIN_MAGIC, sizeof (struct obj_vert),
+                                 sizeof (struct obj_poly),
+                                 sizeof (struct obj_line));
+
+    /* Read the snapshot, accepting it only if whole and consistent. */
+
+    if (bin_open(&B, &H, filename, &K))
+    {
+        bin_get_body(&B, &H, O, key, defer);
+
+        return (bin_close(&B, &H) && bin_check(O));
+    }
+    return 0;
+}
+
+obj *obj_create_bin(const char *filename)
+{
+    obj *O;
+
+    assert(filename);
+
+    /* Create an empty file and fill it from the named snapshot. */
+
+    if ((O = obj_create(NULL)))
+    {
+        if (read_bin(O, filename, NULL, 0))
+            return O;
+
+        obj_delete(O);
+    }
+    return NULL;
+}
+
+static int write_bin(const obj *O, const char *filename, const char *key)
+{
+    struct bin_head H;
+    struct bin      B;
+
+    void **p;
+    size_t s;
+    int    mi;
+    int    si;
+    int    k;
+
+    bin_head_init(&H, BIN_MAGIC, sizeof (struct obj_vert),
+                                 sizeof (struct obj_poly),
+                                 sizeof (struct obj_line));
+    H.mc = (uint32_t) O->mc;
+    H.vc = (uint32_t) O->vc;
+    H.sc = (uint32_t) O->sc;
+
+    /* Write the payload after a header to be completed at the end. */
+
+    if (bin_begin(&B, &H, filename))
+    {
+        bin_put_str(&B, key);
+
+        for (mi = 0; mi < O->mc; ++mi)
+            bin_put_mtrl(&B, O->mv + mi);
+
+        bin_pad(&B, BIN_ALIGN, 1);
+
+        for (k = 0; k < VERT_ARRAYS; ++k)
+        {
+            p = vert_array((obj *) O, k, &s);
+
+            bin_put(&B, *p, O->vc * s);
+            bin_pad(&B, BIN_ALIGN, 1);
+        }
+
+        for (si = 0; si < O->sc; ++si)
+        {
+            const struct obj_surf *sp = O->sv + si;
+
+            bin_put_u(&B, (uint32_t) sp->mi);
+            bin_put_u(&B, (uint32_t) sp->pc);
+            bin_put_u(&B, (uint32_t) sp->lc);
+            bin_pad  (&B, BIN_ALIGN, 1);
+            bin_put  (&B, sp->pv, sp->pc * sizeof (struct obj_poly));
+            bin_pad  (&B, BIN_ALIGN, 1);
+            bin_put  (&B, sp->lv, sp->lc * sizeof (struct obj_line));
+            bin_pad  (&B, BIN_ALIGN, 1);
+        }
+        return bin_end(&B, &H);
+    }
+    return 0;
+}
+
+obj *obj_create_mapped(const char *filename)
+{
+#ifndef CONF_NO_MMAP
+    struct bin_head K;
+    struct bin_head H;
+    struct bin      B;
+    struct stat     st;
+
+    obj  *O;
+    void *v;
+    int   fd;
+
+    assert(filename);
+
+    memset(&B, 0, sizeof (struct bin));
+
+    bin_head_init(&K, BIN_MAGIC, sizeof (struct obj_vert),
+                                 sizeof (struct obj_poly),
+                                 sizeof (struct obj_line));
+
+    /* Create an empty file and map the named snapshot privately into it. */
+
+    if ((O = obj_create(NULL)) == NULL)
+        return NULL;
+
+    if ((fd = open(filename, O_RDONLY)) >= 0)
+    {
+        if (fstat(fd, &st) == 0 && st.st_size > (off_t) sizeof (H) &&
+            (v = mmap(NULL, (size_t) st.st_size, PROT_READ | PROT_WRITE,
+                                      MAP_PRIVATE, fd, 0)) != MAP_FAILED)
+        {
+            O->bp = (char *) v;
+            O->bn = (size_t) st.st_size;
+
+            /* Validate the header and point the arrays into the payload. */
+
+            memcpy(&H, v, sizeof (H));
+
+            if (bin_head_ok(&H, &st, &K))
+            {
+                B.ok = 1;
+                B.p  = O->bp + sizeof (H);
+                B.m  = H.size;
+
+                bin_get_body(&B, &H, O, NULL, 0);
             }
         }
-        free(iv);
+        close(fd);
     }
-    free(qv);
-    free(vv);
+    if (B.ok)
+        return O;
+
+    obj_delete(O);
+    return NULL;
+#else
+    return obj_create_bin(filename);
+#endif
+}
+
+int obj_write_bin(const obj *O, const char *filename)
+{
+    assert(O);
+    assert(filename);
+
+    return write_bin(O, filename, NULL);
+}
+
+/*----------------------------------------------------------------------------*/
+/* Quantized snapshot                                                         */
+
+/* A quantized snapshot trades precision for size. Positions and texture      */
+/* coordinates are quantized within their bounds and normals and tangents are */
+/* octahedral-encoded, all packed into one bit stream. Triangles are coded    */
+/* against FIFOs of recent edges and vertices, so that a triangle sharing an  */
+/* edge with a recent one, and adding a new or recent vertex, takes one byte. */
+
+#define QNT_MAGIC "OBJQ"
+#define QNT_EDGES 15
+#define QNT_VERTS 14
+#define QNT_NEW    0
+#define QNT_FAR   15
+
+struct qnt_bits
+{
+    unsigned char *p;           /* Stream buffer                        */
+    size_t         n;           /* Bytes written or read                */
+    uint64_t       w;           /* Pending bits                         */
+    int            c;           /* Pending bit count                    */
+};
+
+struct qnt_fifo
+{
+    index_t e[16][2];           /* Recent edges, reversed               */
+    index_t v[16];              /* Recent vertices                      */
+    int     ei;                 /* Next edge slot                       */
+    int     vi;                 /* Next vertex slot                     */
+    index_t next;               /* Next vertex not yet seen             */
+};
+
+static void put_bits(struct qnt_bits *W, uint32_t v, int b)
+{
+    W->w |= (uint64_t) v << W->c;
+    W->c += b;
+
+    while (W->c >= 8)
+    {
+        W->p[W->n++] = (unsigned char) W->w;
+        W->w >>= 8;
+        W->c  -= 8;
+    }
+}
+
+static uint32_t get_bits(struct qnt_bits *R, int b)
+{
+    uint32_t v;
+
+    /* The caller guarantees that the stream holds all bits requested. */
+
+    while (R->c < b)
+    {
+        R->w |= (uint64_t) R->p[R->n++] << R->c;
+        R->c += 8;
+    }
+    v = (uint32_t) (R->w & ((UINT64_C(1) << b) - 1));
+
+    R->w >>= b;
+    R->c  -= b;
+
+    return v;
+}
+
+static uint32_t qnt_enc(float x, float lo, float hi, int b)
+{
+    double m = (double) ((UINT32_C(1) << b) - 1);
+    double k = (hi > lo) ? (x - lo) / ((double) hi - lo) * m + 0.5 : 0.0;
+
+    return (uint32_t) ((k > 0) ? ((k < m) ? k : m) : 0);
+}
+
+static float qnt_dec(uint32_t q, float lo, float hi, int b)
+{
+    double m = (double) ((UINT32_C(1) << b) - 1);
+
+    return (float) (lo + ((double) hi - lo) * q / m);
+}
+
+static void oct_dec(float *v, uint32_t qx, uint32_t qy, int b)
+{
+    double m = (double) ((UINT32_C(1) << b) - 1);
+    double x = qx / m * 2.0 - 1.0;
+    double y = qy / m * 2.0 - 1.0;
+    double z = 1.0 - fabs(x) - fabs(y);
+    double t = x;
+
+    /* Unfold the lower hemisphere from the corners of the square. */
+
+    if (z < 0)
+    {
+        x = (1.0 - fabs(y)) * (t >= 0 ? 1.0 : -1.0);
+        y = (1.0 - fabs(t)) * (y >= 0 ? 1.0 : -1.0);
+    }
+    v[0] = (float) x;
+    v[1] = (float) y;
+    v[2] = (float) z;
+
+    normalize(v);
+}
+
+static void oct_enc(const float *v, int b, uint32_t *qx, uint32_t *qy)
+{
+    double m = (double) ((UINT32_C(1) << b) - 1);
+    double s = fabs(v[0]) + fabs(v[1]) + fabs(v[2]);
+    double x = v[0] / s;
+    double y = v[1] / s;
+    double t = x;
+    double d;
+    double e = -2.0;
+    float  w[3];
+    int    i;
+
+    /* Project onto the octahedron and fold the lower hemisphere. */
+
+    if (v[2] < 0)
+    {
+        x = (1.0 - fabs(y)) * (t >= 0 ? 1.0 : -1.0);
+        y = (1.0 - fabs(t)) * (y >= 0 ? 1.0 : -1.0);
+    }
+    x = (x + 1.0) * 0.5 * m;
+    y = (y + 1.0) * 0.5 * m;
+
+    /* Choose the neighboring grid point that decodes nearest the input, */
+    /* starting from the lower one.                                      */
+
+    *qx = (uint32_t) floor(x);
+    *qy = (uint32_t) floor(y);
+
+    for (i = 0; i < 4; ++i)
+    {
+        uint32_t kx = (uint32_t) ((i & 1) ? ceil(x) : floor(x));
+        uint32_t ky = (uint32_t) ((i & 2) ? ceil(y) : floor(y));
+
+        oct_dec(w, kx, ky, b);
+
+        if ((d = w[0] * v[0] + w[1] * v[1] + w[2] * v[2]) > e)
+        {
+            e   = d;
+            *qx = kx;
+            *qy = ky;
+        }
+    }
+}
+
+static int no_dir(const float *v)
+{
+    /* Note a direction that is zero or not finite, and so has no encoding. */
+
+    return ((v[0] == 0 && v[1] == 0 && v[2] == 0) ||
+            !(fabs(v[0]) <= FLT_MAX) ||
+            !(fabs(v[1]) <= FLT_MAX) ||
+            !(fabs(v[2]) <= FLT_MAX));
+}
+
+/*----------------------------------------------------------------------------*/
+
+struct qnt_head
+{
+    uint32_t vb;                /* Position bits                        */
+    uint32_t tb;                /* Texture coordinate bits              */
+    uint32_t nb;                /* Normal and tangent bits              */
+    uint32_t nm;                /* Normals: none, all, or flagged       */
+    uint32_t um;                /* Tangents: none, all, or flagged      */
+    float    vr[6];             /* Position range                       */
+    float    tr[4];             /* Texture coordinate range             */
+};
+
+static int qnt_mode(const obj *O, float (*d)[3])
+{
+    int vi;
+    int z = 0;
+
+    /* Determine whether a direction is always, never, or sometimes absent. */
+
+    for (vi = 0; vi < O->vc; ++vi)
+        if (no_dir(d[vi]))
+            z++;
+
+    return (z == O->vc) ? 0 : (z == 0) ? 1 : 2;
+}
+
+static size_t qnt_vert_bits(const struct qnt_head *Q, int most)
+{
+    /* Give the least or most bits a vertex may take. Flagged directions */
+    /* take one bit when absent.                                         */
+
+    size_t n = 3 * Q->vb + 2 * Q->tb + (Q->nm == 2) + (Q->um == 2);
+
+    if (Q->nm == 1 || (Q->nm == 2 && most)) n += 2 * Q->nb;
+    if (Q->um == 1 || (Q->um == 2 && most)) n += 2 * Q->nb;
+
+    return n;
+}
+
+static void put_dir(struct qnt_bits *W, const float *v, int b, int mode)
+{
+    uint32_t qx;
+    uint32_t qy;
+
+    if (mode == 2)
+        put_bits(W, !no_dir(v), 1);
+
+    if (mode == 1 || (mode == 2 && !no_dir(v)))
+    {
+        oct_enc(v, b, &qx, &qy);
+        put_bits(W, qx, b);
+        put_bits(W, qy, b);
+    }
+}
+
+static void get_dir(struct qnt_bits *R, float *v, int b, int mode)
+{
+    uint32_t qx;
+    uint32_t qy;
+
+    if (mode == 1 || (mode == 2 && get_bits(R, 1)))
+    {
+        qx = get_bits(R, b);
+        qy = get_bits(R, b);
+        oct_dec(v, qx, qy, b);
+    }
+    else v[0] = v[1] = v[2] = 0.0f;
+}
+
+static void qnt_put_vert(struct qnt_bits *W, const struct qnt_head *Q,
+                         const obj *O, int vi)
+{
+    const float *v = O->vv[vi];
+    const float *t = O->tv[vi];
+
+    put_bits(W, qnt_enc(v[0], Q->vr[0], Q->vr[3], Q->vb), Q->vb);
+    put_bits(W, qnt_enc(v[1], Q->vr[1], Q->vr[4], Q->vb), Q->vb);
+    put_bits(W, qnt_enc(v[2], Q->vr[2], Q->vr[5], Q->vb), Q->vb);
+    put_bits(W, qnt_enc(t[0], Q->tr[0], Q->tr[2], Q->tb), Q->tb);
+    put_bits(W, qnt_enc(t[1], Q->tr[1], Q->tr[3], Q->tb), Q->tb);
+
+    put_dir(W, O->nv[vi], Q->nb, Q->nm);
+    put_dir(W, O->uv[vi], Q->nb, Q->um);
+}
+
+static void qnt_get_vert(struct qnt_bits *R, const struct qnt_head *Q,
+                         obj *O, int vi)
+{
+    float *v = O->vv[vi];
+    float *t = O->tv[vi];
+
+    v[0] = qnt_dec(get_bits(R, Q->vb), Q->vr[0], Q->vr[3], Q->vb);
+    v[1] = qnt_dec(get_bits(R, Q->vb), Q->vr[1], Q->vr[4], Q->vb);
+    v[2] = qnt_dec(get_bits(R, Q->vb), Q->vr[2], Q->vr[5], Q->vb);
+    t[0] = qnt_dec(get_bits(R, Q->tb), Q->tr[0], Q->tr[2], Q->tb);
+    t[1] = qnt_dec(get_bits(R, Q->tb), Q->tr[1], Q->tr[3], Q->tb);
+
+    get_dir(R, O->nv[vi], Q->nb, Q->nm);
+    get_dir(R, O->uv[vi], Q->nb, Q->um);
+}
+
+/*----------------------------------------------------------------------------*/
+
+static size_t put_varint(unsigned char *p, uint32_t v)
+{
+    size_t n = 0;
+
+    while (v >= 0x80)
+    {
+        p[n++] = (unsigned char) (v | 0x80);
+        v >>= 7;
+    }
+    p[n++] = (unsigned char) v;
+
+    return n;
+}
+
+static int get_varint(const unsigned char **c, const unsigned char *e,
+                                                    uint32_t *v)
+{
+    int s;
+
+    /* Accept at most five bytes of a 32-bit value. */
+
+    for (*v = 0, s = 0; *c < e && s < 35; s += 7)
+    {
+        *v |= (uint32_t) (**c & 0x7F) << s;
+
+        if ((*(*c)++ & 0x80) == 0)
+            return 1;
+    }
+    return 0;
+}
+
+static uint32_t zigzag(index_t i, index_t j)
+{
+    return (i >= j) ? (uint32_t) (i - j) * 2 : (uint32_t) (j - i) * 2 - 1;
+}
+
+static index_t unzigzag(uint32_t z, index_t j)
+{
+    return (z & 1) ? (index_t) (j - (z + 1) / 2) : (index_t) (j + z / 2);
+}
+
+static void push_edge(struct qnt_fifo *F, index_t a, index_t b)
+{
+    F->e[F->ei][0] = a;
+    F->e[F->ei][1] = b;
+    F->ei = (F->ei + 1) & 15;
+}
+
+static void push_vert(struct qnt_fifo *F, index_t a)
+{
+    F->v[F->vi] = a;
+    F->vi = (F->vi + 1) & 15;
+
+    if (a >= F->next)
+        F->next = a + 1;
+}
+
+static int enc_vert(struct qnt_fifo *F, index_t a, unsigned char *p,
+                                                   size_t *n)
+{
+    int k;
+
+    /* Code a vertex as new, as recently seen, or by its distance. */
+
+    if (a == F->next)
+    {
+        push_vert(F, a);
+        return QNT_NEW;
+    }
+    for (k = 0; k < QNT_VERTS; ++k)
+        if (F->v[(F->vi - 1 - k) & 15] == a)
+            return k + 1;
+
+    *n += put_varint(p + *n, zigzag(a, F->next));
+    push_vert(F, a);
+    return QNT_FAR;
+}
+
+static int dec_vert(struct qnt_fifo *F, int code, const unsigned char **c,
+                    const unsigned char *e, index_t *a)
+{
+    uint32_t z;
+
+    if (code == QNT_NEW)
+    {
+        *a = F->next;
+        push_vert(F, *a);
+        return 1;
+    }
+    if (code < QNT_FAR)
+    {
+        *a = F->v[(F->vi - code) & 15];
+        return 1;
+    }
+    if (get_varint(c, e, &z))
+    {
+        *a = unzigzag(z, F->next);
+        push_vert(F, *a);
+        return 1;
+    }
+    return 0;
 }
 
-float obj_acmr(obj *O, int qc)
+static size_t enc_polys(const struct obj_surf *sp, unsigned char *p)
 {
-    int *vs = (int *) malloc(O->vc * sizeof (int));
-    int  qs = 1;
+    struct qnt_fifo F;
 
-    int si;
-    int vi;
-    int pi;
+    unsigned char t[16];
+    size_t        n = 0;
+    size_t        m;
+    int           pi;
+    int           k;
+    int           r;
 
-    int nn = 0;
-    int dd = 0;
+    memset(&F, 0xFF, sizeof (F));
+    F.ei = F.vi = 0;
+    F.next = 0;
 
-    for (si = 0; si < O->sc; ++si)
+    for (pi = 0; pi < sp->pc; ++pi)
     {
-        for (vi = 0; vi < O->vc; ++vi)
-            vs[vi] = -qc;
+        const index_t *i = sp->pv[pi].vi;
 
-        for (pi = 0; pi < O->sv[si].pc; ++pi)
+        /* Find a recent edge shared with this triangle in any rotation. */
+
+        for (k = 0; k < QNT_EDGES; ++k)
         {
-            const index_t *i = O->sv[si].pv[pi].vi;
+            const index_t *e = F.e[(F.ei - 1 - k) & 15];
 
-            if (qs - vs[i[0]] >= qc) { vs[i[0]] = qs++; nn++; }
-            if (qs - vs[i[1]] >= qc) { vs[i[1]] = qs++; nn++; }
-            if (qs - vs[i[2]] >= qc) { vs[i[2]] = qs++; nn++; }
+            for (r = 0; r < 3; ++r)
+                if (e[0] == i[r] && e[1] == i[(r + 1) % 3])
+                    break;
+            if (r < 3)
+                break;
+        }
 
-            dd++;
+        m = 0;
+
+        if (k < QNT_EDGES)
+        {
+            /* Code the shared edge and the third vertex in one byte. */
+
+            index_t a = i[r];
+            index_t b = i[(r + 1) % 3];
+            index_t c = i[(r + 2) % 3];
+
+            p[n] = (unsigned char) (k << 4 | enc_vert(&F, c, t, &m));
+            memcpy(p + n + 1, t, m);
+            n += m + 1;
+
+            push_edge(&F, c, b);
+            push_edge(&F, a, c);
         }
-    }
+        else
+        {
+            /* Code all three vertices in two bytes. */
 
-    return (float) nn / (float) dd;
-}
+            int ca = enc_vert(&F, i[0], t, &m);
+            int cb = enc_vert(&F, i[1], t, &m);
+            int cc = enc_vert(&F, i[2], t, &m);
 
-/*----------------------------------------------------------------------------*/
+            p[n + 0] = (unsigned char) (QNT_EDGES << 4 | ca);
+            p[n + 1] = (unsigned char) (cb << 4 | cc);
+            memcpy(p + n + 2, t, m);
+            n += m + 2;
 
-#ifndef CONF_NO_GL
+            push_edge(&F, i[1], i[0]);
+            push_edge(&F, i[2], i[1]);
+            push_edge(&F, i[0], i[2]);
+        }
+    }
+    return n;
+}
 
-static void obj_render_prop(const obj *O, int mi, int ki)
+static int dec_polys(struct obj_surf *sp, const unsigned char *c,
+                     const unsigned char *e, index_t vc)
 {
-    const struct obj_prop *kp = O->mv[mi].kv + ki;
+    struct qnt_fifo F;
 
-    if (kp->map)
-    {
-        GLenum wrap = GL_REPEAT;
+    int pi;
+    int k;
 
-        /* Bind the property map. */
+    memset(&F, 0xFF, sizeof (F));
+    F.ei = F.vi = 0;
+    F.next = 0;
 
-        glBindTexture(GL_TEXTURE_2D, kp->map);
+    for (pi = 0; pi < sp->pc && c < e; ++pi)
+    {
+        index_t *i = sp->pv[pi].vi;
 
-        /* Apply the property options. */
+        if ((k = *c >> 4) < QNT_EDGES)
+        {
+            const index_t *d = F.e[(F.ei - 1 - k) & 15];
 
-        if (kp->opt & OBJ_OPT_CLAMP)
-            wrap = GL_CLAMP_TO_EDGE;
+            /* Extend a recent edge by one vertex. */
 
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap);
+            i[0] = d[0];
+            i[1] = d[1];
 
-        /* Apply the texture coordinate offset and scale. */
+            if (!dec_vert(&F, *c++ & 15, &c, e, i + 2))
+                return 0;
 
-        if (O->Mloc[ki] >= 0)
+            push_edge(&F, i[2], i[1]);
+            push_edge(&F, i[0], i[2]);
+        }
+        else
         {
-            GLfloat T[16];
+            /* Decode three vertices. */
 
-            memset(T, 0, sizeof (T));
+            const unsigned char *d = c;
 
-            T[ 0] = kp->s[0];
-            T[ 5] = kp->s[1];
-            T[10] = kp->s[2];
-            T[12] = kp->o[0];
-            T[13] = kp->o[1];
-            T[14] = kp->o[2];
-            T[15] = 1.0f;
+            if (e - c < 2)
+                return 0;
 
-            glUniformMatrix4fv(O->Mloc[ki], 1, GL_FALSE, T);
+            c += 2;
+
+            if (!dec_vert(&F, d[0] & 15, &c, e, i + 0) ||
+                !dec_vert(&F, d[1] >> 4, &c, e, i + 1) ||
+                !dec_vert(&F, d[1] & 15, &c, e, i + 2))
+                return 0;
+
+            push_edge(&F, i[1], i[0]);
+            push_edge(&F, i[2], i[1]);
+            push_edge(&F, i[0], i[2]);
         }
+        if (i[0] >= vc || i[1] >= vc || i[2] >= vc)
+            return 0;
     }
-    else glBindTexture(GL_TEXTURE_2D, 0);
+    return (pi == sp->pc && c == e);
 }
 
-void obj_render_mtrl(const obj *O, int mi)
+static size_t enc_lines(const struct obj_surf *sp, unsigned char *p)
 {
-    int ki;
+    index_t j = 0;
+    size_t  n = 0;
+    int     li;
 
-    /* Bind all material properties and texture maps. */
+    /* Code each line vertex by its distance from the one before. */
 
-    for (ki = 0; ki < OBJ_PROP_COUNT; ki++)
+    for (li = 0; li < sp->lc; ++li)
     {
-        if (O->oloc[ki] >= 0)
-        {
-            glActiveTexture(GL_TEXTURE0 + ki);
-            obj_render_prop(O, mi, ki);
-            glUniform1i(O->oloc[ki], ki);
-        }
-        if (O->cloc[ki] >= 0)
-            glUniform4fv(O->cloc[ki], 1, O->mv[mi].kv[ki].c);
+        n += put_varint(p + n, zigzag(sp->lv[li].vi[0], j));
+        n += put_varint(p + n, zigzag(sp->lv[li].vi[1], sp->lv[li].vi[0]));
+        j  = sp->lv[li].vi[1];
     }
-    glActiveTexture(GL_TEXTURE0);
+    return n;
 }
 
-void obj_render_surf(const obj *O, int si)
+static int dec_lines(struct obj_surf *sp, const unsigned char *c,
+                     const unsigned char *e, index_t vc)
 {
-    const struct obj_surf *sp = O->sv + si;
+    index_t  j = 0;
+    uint32_t z;
+    int      li;
 
-    if (0 < sp->pc || sp->lc > 0)
+    for (li = 0; li < sp->lc; ++li)
     {
-        /* Apply this surface's material. */
-
-        if (0 <= sp->mi && sp->mi < O->mc)
-            obj_render_mtrl(O, sp->mi);
-
-        /* Render all polygons. */
-
-        if (sp->pibo)
-        {
-            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sp->pibo);
-            glDrawElements(GL_TRIANGLES, 3 * sp->pc, GL_INDEX_T, (const GLvoid *) 0);
-        }
+        if (!get_varint(&c, e, &z)) return 0;
+        sp->lv[li].vi[0] = j = unzigzag(z, j);
 
-        /* Render all lines. */
+        if (!get_varint(&c, e, &z)) return 0;
+        sp->lv[li].vi[1] = j = unzigzag(z, j);
 
-        if (sp->libo)
-        {
-            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sp->libo);
-            glDrawElements(GL_LINES, 2 * sp->lc, GL_INDEX_T, (const GLvoid *) 0);
-        }
+        if (sp->lv[li].vi[0] >= vc || sp->lv[li].vi[1] >= vc)
+            return 0;
     }
+    return (c == e);
 }
 
-void obj_render(obj *O)
+/*----------------------------------------------------------------------------*/
+
+static void qnt_put_codes(struct bin *B, unsigned char *p, size_t n)
 {
-    int si;
+    bin_put_u(B, (uint32_t) n);
+    bin_put  (B, p, n);
+}
 
-    assert(O);
+static unsigned char *qnt_get_codes(struct bin *B, const struct bin_head *H,
+                                    size_t *n, size_t m)
+{
+    unsigned char *p = NULL;
 
-    /* Initialize the vertex arrays. */
+    /* Read a length-prefixed code stream of at most m bytes, if m is     */
+    /* given, into a buffer of that size padded with zeros.               */
 
-    obj_init(O);
+    *n = bin_get_u(B);
 
-    /* Render each surface. */
+    if (m == 0)
+        m = *n;
 
-    glBindVertexArray(O->vao);
+    if (*n <= m && bin_fits(B, H, (uint32_t) *n, 1) &&
+        (p = (unsigned char *) calloc(m + 8, 1)))
+        bin_get(B, p, *n);
+    else
+        B->ok = 0;
 
-    for (si = 0; si < O->sc; ++si)
-        obj_render_surf(O, si);
+    return p;
 }
 
-#else
-
-void obj_render(obj *O)
+static void qnt_get_surf(struct bin *B, const struct bin_head *H,
+                         struct obj_surf *sp, index_t vc)
 {
-}
-
-#endif
+    unsigned char *p;
 
-/*============================================================================*/
+    uint32_t pc;
+    uint32_t lc;
+    size_t   n;
 
-void obj_bound(const obj *O, float *b)
-{
-    int vi;
+    sp->mi = (int) bin_get_u(B);
+    pc     =       bin_get_u(B);
+    lc     =       bin_get_u(B);
 
-    assert(O);
+    /* A triangle takes at least one byte and a line at least two. */
 
-    /* Compute the bounding box of this object. */
+    if (bin_fits(B, H, pc, 1) == 0 || bin_fits(B, H, lc, 2) == 0)
+        B->ok = 0;
 
-    if (O->vc > 0)
+    if (B->ok && pc > 0)
     {
-        const float *v = O->vv[0].v;
-
-        b[0] = b[3] = v[0];
-        b[1] = b[4] = v[1];
-        b[2] = b[5] = v[2];
+        if ((sp->pv = (struct obj_poly *) malloc(pc * sizeof (*sp->pv))))
+            sp->pc = sp->pm = (int) pc;
+        else
+            B->ok = 0;
     }
-
-    for (vi = 0; vi < O->vc; ++vi)
+    if (B->ok && lc > 0)
     {
-        const float *v = O->vv[vi].v;
+        if ((sp->lv = (struct obj_line *) malloc(lc * sizeof (*sp->lv))))
+            sp->lc = sp->lm = (int) lc;
+        else
+            B->ok = 0;
+    }
 
-        if (b[0] > v[0]) b[0] = v[0];
-        if (b[1] > v[1]) b[1] = v[1];
-        if (b[2] > v[2]) b[2] = v[2];
+    /* Decode the polygon and line streams. */
 
-        if (b[3] < v[0]) b[3] = v[0];
-        if (b[4] < v[1]) b[4] = v[1];
-        if (b[5] < v[2]) b[5] = v[2];
-    }
-}
+    if ((p = qnt_get_codes(B, H, &n, 0)) && B->ok)
+        if (dec_polys(sp, p, p + n, vc) == 0)
+            B->ok = 0;
+    free(p);
 
-/*============================================================================*/
+    if ((p = qnt_get_codes(B, H, &n, 0)) && B->ok)
+        if (dec_lines(sp, p, p + n, vc) == 0)
+            B->ok = 0;
+    free(p);
+}
 
-static void obj_write_map(FILE *fout, const obj *O, int mi, int ki, const char *s)
+obj *obj_create_quant(const char *filename)
 {
-    struct obj_prop *kp = O->mv[mi].kv + ki;
+    struct qnt_head Q;
+    struct qnt_bits R;
+    struct bin_head K;
+    struct bin_head H;
+    struct bin      B;
 
-    /* If this property has a map... */
+    obj   *O;
+    size_t n = 0;
+    int    mi;
+    int    si;
+    int    vi;
 
-    if (kp->str)
-    {
-        fprintf(fout, "map_%s ", s);
+    assert(filename);
 
-        /* Store all map options. */
+    memset(&R, 0, sizeof (struct qnt_bits));
 
-        if ((kp->opt & OBJ_OPT_CLAMP) != 0) fprintf(fout, "-clamp on ");
+    bin_head_init(&K, QNT_MAGIC, 0, 0, 0);
 
-        /* Store the map offset, if any. */
+    /* Create an empty file and fill it from the named snapshot. */
 
-        if (fabs(kp->o[0]) > 0 ||
-            fabs(kp->o[1]) > 0 ||
-            fabs(kp->o[2]) > 0) fprintf(fout, "-o %f %f %f ",
-                                        kp->o[0], kp->o[1], kp->o[2]);
+    if ((O = obj_create(NULL)) == NULL)
+        return NULL;
 
-        /* Store the map scale, if any. */
+    if (bin_open(&B, &H, filename, &K))
+    {
+        /* Read the materials and the quantization parameters. */
 
-        if (fabs(kp->s[0] - 1) > 0 ||
-            fabs(kp->s[1] - 1) > 0 ||
-            fabs(kp->s[2] - 1) > 0) fprintf(fout, "-s %f %f %f ",
-                                            kp->s[0], kp->s[1], kp->s[2]);
+        for (mi = 0; mi < (int) H.mc && B.ok; ++mi)
+            if (obj_add_mtrl(O) == mi)
+                bin_get_mtrl(&B, O, mi, 0);
+            else
+                B.ok = 0;
 
-        /* Store the map image file name. */
+        bin_get(&B, &Q, sizeof (struct qnt_head));
 
-        fprintf(fout, "%s\n", kp->str);
-    }
-}
+        if (Q.vb < 1 || Q.vb > 24 || Q.tb < 1 || Q.tb > 24 ||
+            Q.nb < 2 || Q.nb > 24 || Q.nm > 2 || Q.um > 2)
+            B.ok = 0;
 
-static void obj_write_mtl(const obj *O, const char *mtl)
-{
-    FILE *fout;
-    int   mi;
+        /* Decode the vertex stream, which must hold every vertex. The  */
+        /* buffer admits the longest vertices, so decoding cannot overrun. */
 
-    if ((fout = fopen(mtl, "w")))
-    {
-        for (mi = 0; mi < O->mc; ++mi)
+        if (B.ok && H.vc > 0)
         {
-            struct obj_mtrl *mp = O->mv + mi;
+            if (bin_fits(&B, &H, H.vc, qnt_vert_bits(&Q, 0) / 8) == 0)
+                B.ok = 0;
 
-            /* Start a new material. */
+            R.p = qnt_get_codes(&B, &H, &n,
+                                (qnt_vert_bits(&Q, 1) * H.vc + 7) / 8);
 
-            if (mp->name)
-                fprintf(fout, "newmtl %s\n", mp->name);
-            else
-                fprintf(fout, "newmtl default\n");
+            if (B.ok && reserve_vert(O, (int) H.vc))
+            {
+                O->vc = (int) H.vc;
 
-            /* Store all material property colors. */
+                for (vi = 0; vi < O->vc; ++vi)
+                    qnt_get_vert(&R, &Q, O, vi);
 
-            fprintf(fout, "Kd %12.8f %12.8f %12.8f\n", mp->kv[OBJ_KD].c[0],
-                                                       mp->kv[OBJ_KD].c[1],
-                                                       mp->kv[OBJ_KD].c[2]);
-            fprintf(fout, "Ka %12.8f %12.8f %12.8f\n", mp->kv[OBJ_KA].c[0],
-                                                       mp->kv[OBJ_KA].c[1],
-                                                       mp->kv[OBJ_KA].c[2]);
-            fprintf(fout, "Ke %12.8f %12.8f %12.8f\n", mp->kv[OBJ_KE].c[0],
-                                                       mp->kv[OBJ_KE].c[1],
-                                                       mp->kv[OBJ_KE].c[2]);
-            fprintf(fout, "Ks %12.8f %12.8f %12.8f\n", mp->kv[OBJ_KS].c[0],
-                                                       mp->kv[OBJ_KS].c[1],
-                                                       mp->kv[OBJ_KS].c[2]);
+                if ((R.n * 8 - R.c + 7) / 8 != n)
+                    B.ok = 0;
+            }
+            else B.ok = 0;
 
-            fprintf(fout, "Ns %12.8f\n", mp->kv[OBJ_NS].c[0]);
-            fprintf(fout, "d  %12.8f\n", mp->kv[OBJ_KD].c[3]);
+            free(R.p);
+        }
 
-            /* Store all material property maps. */
+        /* Decode each surface. */
 
-            obj_write_map(fout, O, mi, OBJ_KD, "Kd");
-            obj_write_map(fout, O, mi, OBJ_KA, "Ka");
-            obj_write_map(fout, O, mi, OBJ_KA, "Ke");
-            obj_write_map(fout, O, mi, OBJ_KS, "Ks");
-            obj_write_map(fout, O, mi, OBJ_NS, "Ns");
-            obj_write_map(fout, O, mi, OBJ_KN, "Kn");
-        }
+        for (si = 0; si < (int) H.sc && B.ok; ++si)
+            if (obj_add_surf(O) == si)
+                qnt_get_surf(&B, &H, O->sv + si, (index_t) H.vc);
+            else
+                B.ok = 0;
+
+        if (bin_close(&B, &H) && bin_check(O))
+            return O;
     }
-    fclose(fout);
+    obj_delete(O);
+    return NULL;
 }
 
-static void obj_write_obj(const obj *O, const char *obj,
-                                        const char *mtl, int prec)
+int obj_write_quant(const obj *O, const char *filename, int vb, int tb,
+                                                        int nb)
 {
-    FILE *fout;
+    struct qnt_head Q;
+    struct qnt_bits W;
+    struct bin_head H;
+    struct bin      B;
 
-    if ((fout = fopen(obj, "w")))
-    {
-        char formv[256];
-        char formt[256];
-        char formn[256];
+    unsigned char *p;
+    size_t         m;
+    int            mi;
+    int            si;
+    int            vi;
 
-        int si;
-        int vi;
-        int pi;
-        int li;
+    assert(O);
+    assert(filename);
+    assert(1 <= vb && vb <= 24);
+    assert(1 <= tb && tb <= 24);
+    assert(2 <= nb && nb <= 24);
 
-        if (mtl) fprintf(fout, "mtllib %s\n", mtl);
+    /* Find the ranges of positions and texture coordinates. */
 
-        /* Store all vertex data. */
+    memset(&Q, 0, sizeof (struct qnt_head));
+    memset(&W, 0, sizeof (struct qnt_bits));
 
-        sprintf(formv, "v %%.%df %%.%df %%.%df\n",  prec, prec, prec);
-        sprintf(formt, "vt %%.%df %%.%df\n",        prec, prec);
-        sprintf(formn, "vn %%.%df %%.%df %%.%df\n", prec, prec, prec);
+    obj_bound(O, Q.vr);
 
-        for (vi = 0; vi < O->vc; ++vi)
-            fprintf(fout, formv, O->vv[vi].v[0],
-                                 O->vv[vi].v[1],
-                                 O->vv[vi].v[2]);
-        for (vi = 0; vi < O->vc; ++vi)
-            fprintf(fout, formt, O->vv[vi].t[0],
-                                 O->vv[vi].t[1]);
-        for (vi = 0; vi < O->vc; ++vi)
-            fprintf(fout, formn, O->vv[vi].n[0],
-                                 O->vv[vi].n[1],
-                                 O->vv[vi].n[2]);
+    for (vi = 0; vi < O->vc; ++vi)
+    {
+        const float *t = O->tv[vi];
 
-        for (si = 0; si < O->sc; ++si)
-        {
-            int mi = O->sv[si].mi;
+        if (vi == 0 || Q.tr[0] > t[0]) Q.tr[0] = t[0];
+        if (vi == 0 || Q.tr[1] > t[1]) Q.tr[1] = t[1];
+        if (vi == 0 || Q.tr[2] < t[0]) Q.tr[2] = t[0];
+        if (vi == 0 || Q.tr[3] < t[1]) Q.tr[3] = t[1];
+    }
 
-            /* Store the surface's material reference */
+    Q.vb = (uint32_t) vb;
+    Q.tb = (uint32_t) tb;
+    Q.nb = (uint32_t) nb;
+    Q.nm = (uint32_t) qnt_mode(O, O->nv);
+    Q.um = (uint32_t) qnt_mode(O, O->uv);
 
-            if (0 <= mi && mi < O->mc && O->mv[mi].name)
-                fprintf(fout, "usemtl %s\n", O->mv[O->sv[si].mi].name);
-            else
-                fprintf(fout, "usemtl default\n");
+    /* Size a buffer for the largest stream: vertices or worst-case codes. */
 
-            /* Store all polygon definitions. */
+    m = (qnt_vert_bits(&Q, 1) * O->vc + 7) / 8;
 
-            for (pi = 0; pi < O->sv[si].pc; pi++)
-            {
-                int vi0 = O->sv[si].pv[pi].vi[0] + 1;
-                int vi1 = O->sv[si].pv[pi].vi[1] + 1;
-                int vi2 = O->sv[si].pv[pi].vi[2] + 1;
+    for (si = 0; si < O->sc; ++si)
+    {
+        if (m < (size_t) O->sv[si].pc * 17) m = (size_t) O->sv[si].pc * 17;
+        if (m < (size_t) O->sv[si].lc * 10) m = (size_t) O->sv[si].lc * 10;
+    }
 
-                fprintf(fout, "f %d/%d/%d %d/%d/%d %d/%d/%d\n", vi0, vi0, vi0,
-                                                                vi1, vi1, vi1,
-                                                                vi2, vi2, vi2);
-            }
+    if ((p = (unsigned char *) malloc(m + 8)) == NULL)
+        return 0;
 
-            /* Store all line definitions. */
+    bin_head_init(&H, QNT_MAGIC, 0, 0, 0);
+    H.mc = (uint32_t) O->mc;
+    H.vc = (uint32_t) O->vc;
+    H.sc = (uint32_t) O->sc;
 
-            for (li = 0; li < O->sv[si].lc; li++)
-            {
-                int vi0 = O->sv[si].lv[li].vi[0] + 1;
-                int vi1 = O->sv[si].lv[li].vi[1] + 1;
+    /* Write the materials, parameters, vertices, and surfaces. */
 
-                fprintf(fout, "l %d/%d/%d %d/%d/%d\n", vi0, vi0, vi0,
-                                                       vi1, vi1, vi1);
-            }
+    if (bin_begin(&B, &H, filename))
+    {
+        for (mi = 0; mi < O->mc; ++mi)
+            bin_put_mtrl(&B, O->mv + mi);
+
+        bin_put(&B, &Q, sizeof (struct qnt_head));
+
+        if (O->vc > 0)
+        {
+            W.p = p;
+
+            for (vi = 0; vi < O->vc; ++vi)
+                qnt_put_vert(&W, &Q, O, vi);
+
+            put_bits(&W, 0, 7);
+            qnt_put_codes(&B, p, W.n);
         }
 
-        fclose(fout);
-    }
-}
+        for (si = 0; si < O->sc; ++si)
+        {
+            const struct obj_surf *sp = O->sv + si;
 
-void obj_write(const obj *O, const char *obj, const char *mtl, int prec)
-{
-    assert(O);
+            bin_put_u(&B, (uint32_t) sp->mi);
+            bin_put_u(&B, (uint32_t) sp->pc);
+            bin_put_u(&B, (uint32_t) sp->lc);
 
-    if (obj) obj_write_obj(O, obj, mtl, prec);
-    if (mtl) obj_write_mtl(O, mtl);
+            qnt_put_codes(&B, p, enc_polys(sp, p));
+            qnt_put_codes(&B, p, enc_lines(sp, p));
+        }
+        free(p);
+        return bin_end(&B, &H);
+    }
+    free(p);
+    return 0;
 }
 
 /*============================================================================*/
@@ -21,6 +21,8 @@
 #ifndef UTIL3D_OBJ_H
 #define UTIL3D_OBJ_H
 
+#include <stddef.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -39,11 +41,78 @@ enum {
 
 #define OBJ_OPT_CLAMP  1
 
+#define OBJ_READ_MMAP  1
+#define OBJ_READ_SCAN  2
+
+#define OBJ_WRITE_COMPACT 1
+
+#define OBJ_VERT_HALF_V   1
+#define OBJ_VERT_SNORM_N  2
+#define OBJ_VERT_HALF_T   4
+#define OBJ_VERT_UNORM_T  8
+
+enum {
+	OBJ_PROG_READ,
+	OBJ_PROG_UNIQ,
+	OBJ_PROG_SORT,
+	OBJ_PROG_NORM,
+	OBJ_PROG_PROC
+};
+
+enum {
+	OBJ_NAME_MTLLIB,
+	OBJ_NAME_USEMTL,
+	OBJ_NAME_MAP,
+	OBJ_NAME_OBJECT,
+	OBJ_NAME_GROUP
+};
+
+struct obj_info
+{
+	int vc;                     /* Vertex positions                     */
+	int tc;                     /* Texture coordinates                  */
+	int nc;                     /* Normals                              */
+	int fc;                     /* Face records                         */
+	int pc;                     /* Triangles after fanning faces        */
+	int lc;                     /* Line records                         */
+	int sc;                     /* Segments after splitting lines       */
+	int uc;                     /* usemtl records                       */
+	int mc;                     /* MTL libraries named                  */
+
+	float bound[6];             /* Position minimum and maximum         */
+};
+
 /*----------------------------------------------------------------------------*/
 
-typedef struct obj obj;
+typedef struct obj      obj;
+typedef struct obj_load obj_load;
+
+typedef void *(*obj_resolver)(void *, const char *, size_t *);
+typedef void  (*obj_reporter)(void *, int, const char *);
+typedef int   (*obj_progress)(void *, int, size_t, size_t);
+typedef int   (*obj_selector)(void *, int, const char *);
+typedef int   (*obj_writer)  (void *, const void *, size_t);
 
 obj *obj_create(const char *);
+int  obj_read  (obj *, const char *);
+
+void obj_set_cache(const char *, float, float, int);
+
+obj *obj_create_bin   (const char *);
+obj *obj_create_mapped(const char *);
+obj *obj_create_quant (const char *);
+obj *obj_create_async (const char *);
+int  obj_read_async   (obj *, const char *);
+int  obj_poll         (obj *);
+int  obj_wait         (obj *);
+
+obj_load *obj_load_begin(obj *, obj_resolver, void *);
+int       obj_load_feed (obj_load *, const void *, size_t);
+void      obj_load_end  (obj_load *);
+
+int  obj_probe(const char *, struct obj_info *, obj_reporter, void *);
+
+void obj_init  (obj *);
 void obj_render(obj *);
 void obj_delete(obj *);
 
@@ -87,6 +156,12 @@ void obj_set_surf(obj *, int, int);
 
 void obj_set_vert_loc(obj *, int, int, int, int);
 void obj_set_prop_loc(obj *, int, int, int, int);
+void obj_set_read_opt (obj *, unsigned int);
+void obj_set_write_opt(obj *, unsigned int);
+void obj_set_vert_fmt (obj *, unsigned int);
+void obj_set_threads  (obj *, int);
+void obj_set_progress (obj *, obj_progress, void *);
+void obj_set_select   (obj *, obj_selector, void *);
 
 /*----------------------------------------------------------------------------*/
 
@@ -107,9 +182,10 @@ int  obj_get_surf(const obj *, int);
 
 /*----------------------------------------------------------------------------*/
 
-void  obj_render_mtrl(const obj *, int);
-void  obj_render_surf(const obj *, int);
-void  obj_render_file(const obj *);
+void   obj_render_mtrl(const obj *, int);
+void   obj_render_surf(const obj *, int);
+void   obj_render_file(const obj *);
+size_t obj_pack_vert  (const obj *, void *);
 
 /*----------------------------------------------------------------------------*/
 
@@ -124,6 +200,9 @@ float obj_acmr(obj *, int);
 
 void  obj_bound(const obj *, float *);
 void  obj_write(const obj *, const char *, const char *, int);
+int   obj_write_to(const obj *, obj_writer, void *, const char *, int);
+int   obj_write_bin(const obj *, const char *);
+int   obj_write_quant(const obj *, const char *, int, int, int);
 
 /*======================================================================+=====*/
 